@@ -3,12 +3,15 @@
 #include <brainfuck/backends/flat/monolithic-codegen.hpp>
 #include <brainfuck/parser.hpp>
 
-/// Parse and run program using the flat AST backend
+/// Parse and run program using the flat AST backend.
+/// Passes are disabled, as they fold the benchmark
+/// programs away.
 template <auto const &ProgramString>
 inline void run_program() {
   static constexpr auto FlatAst =
       brainfuck::flat::parse_to_fixed_flat_ast<
-          ProgramString>(); // ok
+          ProgramString,
+          brainfuck::flat::o0_v>(); // ok
 
   brainfuck::program_state_t s;
   auto fun =
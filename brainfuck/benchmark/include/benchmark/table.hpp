@@ -0,0 +1,21 @@
+#pragma once
+
+#include <brainfuck/backends/flat/table-codegen.hpp>
+#include <brainfuck/parser.hpp>
+
+/// Parse and run program using the function pointer
+/// table backend. Passes are disabled, as they fold
+/// the benchmark programs away.
+template <auto const &ProgramString>
+inline void run_program() {
+  static constexpr auto FlatAst =
+      brainfuck::flat::parse_to_fixed_flat_ast<
+          ProgramString,
+          brainfuck::flat::o0_v>(); // ok
+
+  brainfuck::program_state_t s;
+  auto fun =
+      brainfuck::flat::table::codegen<FlatAst>();
+
+  fun(s);
+}
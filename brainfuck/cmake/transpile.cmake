@@ -0,0 +1,41 @@
+# Ahead-of-time BF program targets
+
+# brainfuck_add_program(<target> <program.bf>
+#                       [FUNCTION <name>] [OPT_LEVEL <0-3>] [CHECKED])
+#
+# Transpiles a BF program to C++ at build time, and adds it as a static
+# library. The library declares the following function in <target>.hpp:
+#
+#   std::size_t <name>(char *data, std::size_t size, std::size_t i);
+#
+# which runs the program on a tape of the given size starting at pointer i, and
+# returns the final pointer. The function is named after the target by default.
+# CHECKED enables tape bounds checks.
+function(brainfuck_add_program target program)
+  cmake_parse_arguments(BF "CHECKED" "FUNCTION;OPT_LEVEL" "" ${ARGN})
+
+  if(NOT BF_FUNCTION)
+    set(BF_FUNCTION ${target})
+  endif()
+  if(NOT DEFINED BF_OPT_LEVEL)
+    set(BF_OPT_LEVEL 3)
+  endif()
+
+  set(flags -O${BF_OPT_LEVEL} --name ${BF_FUNCTION})
+  if(BF_CHECKED)
+    list(APPEND flags --checked)
+  endif()
+
+  get_filename_component(program ${program} ABSOLUTE)
+  set(output ${CMAKE_CURRENT_BINARY_DIR}/${target})
+
+  add_custom_command(
+    OUTPUT ${output}.hpp ${output}.cpp
+    COMMAND brainfuck-transpile ${flags} ${program} ${output}
+    DEPENDS brainfuck-transpile ${program}
+    COMMENT "Transpiling ${program}"
+    VERBATIM)
+
+  add_library(${target} STATIC ${output}.cpp)
+  target_include_directories(${target} PUBLIC ${CMAKE_CURRENT_BINARY_DIR})
+endfunction()
@@ -92,53 +92,53 @@ template <typename f> constexpr auto to_et(f) {
 
 template <typename... Ts>
 inline auto codegen(et_block_t<Ts...>) {
-  return [](program_state_t &state) {
+  return [](auto &state) {
     (codegen(Ts{})(state), ...);
   };
 }
 
 template <typename... Ts>
 inline auto codegen(et_while_t<Ts...>) {
-  return [](program_state_t &state) {
+  return [](auto &state) {
     while (state.data[state.i])
       (codegen(Ts{})(state), ...);
   };
 }
 
 inline auto codegen(et_token_t<pointer_increase_v>) {
-  return [](program_state_t &state) { ++state.i; };
+  return [](auto &state) { ++state.i; };
 }
 
 inline auto codegen(et_token_t<pointer_decrease_v>) {
-  return [](program_state_t &state) { --state.i; };
+  return [](auto &state) { --state.i; };
 }
 
 inline auto codegen(et_token_t<pointee_increase_v>) {
-  return [](program_state_t &state) {
+  return [](auto &state) {
     state.data[state.i]++;
   };
 }
 
 inline auto codegen(et_token_t<pointee_decrease_v>) {
-  return [](program_state_t &state) {
+  return [](auto &state) {
     state.data[state.i]--;
   };
 }
 
 inline auto codegen(et_token_t<put_v>) {
-  return [](program_state_t &state) {
-    std::putchar(state.data[state.i]);
+  return [](auto &state) {
+    output_char(state, state.data[state.i]);
   };
 }
 
 inline auto codegen(et_token_t<get_v>) {
-  return [](program_state_t &state) {
-    state.data[state.i] = std::getchar();
+  return [](auto &state) {
+    state.data[state.i] = input_char(state);
   };
 }
 
 inline auto codegen(et_token_t<nop_v>) {
-  return [](program_state_t &s) {};
+  return [](auto &s) {};
 }
 
 } // namespace brainfuck::expression_template
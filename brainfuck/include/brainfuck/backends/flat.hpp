@@ -14,6 +14,10 @@
 #include <vector>
 
 #include <brainfuck/ast.hpp>
+#include <brainfuck/backends/flat/ast.hpp>
+#include <brainfuck/backends/flat/pass-manager.hpp>
+#include <brainfuck/backends/flat/scan.hpp>
+#include <brainfuck/backends/flat/tape-bounds.hpp>
 #include <brainfuck/parser.hpp>
 #include <brainfuck/program.hpp>
 
@@ -21,39 +25,6 @@ namespace brainfuck::flat {
 
 using std::size_t;
 
-// ===============================================
-// AST type definitions
-
-/// Represents a single instruction token
-struct flat_token_t {
-  token_t token;
-};
-
-/// Block descriptor at the beginning of every block
-/// of adjacent instructions.
-struct flat_block_descriptor_t {
-  size_t size;
-};
-
-/// Represents a while instruction, pointing to
-/// another instruction block
-struct flat_while_t {
-  size_t block_begin;
-};
-
-/// Polymorphic representation of a node
-using flat_node_t =
-    std::variant<flat_token_t,
-                 flat_block_descriptor_t,
-                 flat_while_t>;
-
-/// AST container type
-using flat_ast_t = std::vector<flat_node_t>;
-
-/// NTTP-compatible AST container type
-template <size_t N>
-using fixed_flat_ast_t = std::array<flat_node_t, N>;
-
 // ===============================================
 // generate_blocks overloads
 
@@ -164,21 +135,140 @@ flatten(ast_node_ptr_t const &parser_input) {
   return serialized_ast;
 }
 
+/// Parses a BF program into a flat AST, and runs the
+/// optimization pipeline of the given level on it,
+/// see make_pipeline. If bounds_checks is true,
+/// flat_check_t nodes are inserted wherever tape
+/// accesses are not proven to be in bounds. Cells
+/// are cell_size bytes wide, see
+/// basic_program_state_t.
+constexpr pipeline_result_t optimize_flat_ast(
+    std::string const &program,
+    optimization_level_t level =
+        default_optimization_level,
+    bool bounds_checks = false,
+    size_t cell_size = 1) {
+  return run_pipeline(
+      flatten(parser::parse_ast(program)),
+      make_pipeline(level, bounds_checks, cell_size));
+}
+
+/// Parses a BF program into an optimized flat AST,
+/// see optimize_flat_ast.
+constexpr flat_ast_t parse_to_flat_ast(
+    std::string const &program,
+    optimization_level_t level =
+        default_optimization_level,
+    bool bounds_checks = false,
+    size_t cell_size = 1) {
+  return optimize_flat_ast(program, level,
+                           bounds_checks, cell_size)
+      .ast;
+}
+
 /// Parses a BF program into a fixed_flat_ast_t value.
-template <auto const &ProgramString>
+template <auto const &ProgramString,
+          optimization_level_t Level =
+              default_optimization_level,
+          bool BoundsChecks = false,
+          size_t CellSize = 1>
 constexpr auto parse_to_fixed_flat_ast() {
   // Getting AST vector size into a constexpr variable
   constexpr size_t AstArraySize =
-      flatten(parser::parse_ast(ProgramString))
+      parse_to_flat_ast(ProgramString, Level,
+                        BoundsChecks, CellSize)
           .size();
 
   // Initializing static size array
-  fixed_flat_ast_t<AstArraySize> arr;
+  fixed_flat_ast_t<AstArraySize, CellSize> arr;
   std::ranges::copy(
-      flatten(parser::parse_ast(ProgramString)),
+      parse_to_flat_ast(ProgramString, Level,
+                        BoundsChecks, CellSize),
       arr.begin());
 
   return arr;
 }
 
+/// Pass reports of the pipeline run by
+/// parse_to_fixed_flat_ast, as a fixed size array.
+template <auto const &ProgramString,
+          optimization_level_t Level =
+              default_optimization_level,
+          bool BoundsChecks = false,
+          size_t CellSize = 1>
+inline constexpr auto optimization_report = [] {
+  constexpr size_t PassCount =
+      make_pipeline(Level, BoundsChecks, CellSize)
+          .size();
+
+  std::array<pass_report_t, PassCount> reports;
+  std::ranges::copy(
+      optimize_flat_ast(ProgramString, Level,
+                        BoundsChecks, CellSize)
+          .reports,
+      reports.begin());
+  return reports;
+}();
+
+/// Returns the size of the cells accessed by a
+/// fixed_flat_ast_t if they are all known statically,
+/// or the default tape size otherwise.
+template <auto const &Ast>
+constexpr size_t sized_tape_size() {
+  size_t const size =
+      analyze_tape_bounds(
+          flat_ast_t(Ast.begin(), Ast.end()))
+          .tape_size();
+  return size != 0 ? size : default_tape_size;
+}
+
+/// Program state whose tape is sized to fit a
+/// fixed_flat_ast_t. Accesses that are not proven to
+/// fit are covered by flat_check_t nodes.
+template <auto const &Ast, typename Cell = char,
+          typename Storage = inline_storage_t,
+          typename IO = stdio_io_t>
+using sized_program_state_t =
+    basic_program_state_t<sized_tape_size<Ast>(),
+                          Cell, Storage, IO>;
+
+// ===============================================
+// Codegen helpers
+
+/// Returns the number of consecutive flat_print_t
+/// nodes starting at position Pos.
+template <auto const &Ast, size_t Pos>
+constexpr size_t print_run_length() {
+  size_t length = 0;
+  while (Pos + length < Ast.size() &&
+         holds_alternative<flat_print_t>(
+             Ast[Pos + length])) {
+    length++;
+  }
+  return length;
+}
+
+/// Returns true if the node at position Pos is a
+/// flat_print_t node that continues a run started
+/// earlier, in which case the backends emit nothing
+/// for it.
+template <auto const &Ast, size_t Pos>
+constexpr bool continues_print_run() {
+  return Pos > 0 &&
+         holds_alternative<flat_print_t>(Ast[Pos]) &&
+         holds_alternative<flat_print_t>(
+             Ast[Pos - 1]);
+}
+
+/// Characters of the flat_print_t run starting at
+/// position Pos.
+template <auto const &Ast, size_t Pos>
+inline constexpr auto print_run = [] {
+  std::array<char, print_run_length<Ast, Pos>()> run;
+  for (size_t i = 0; i < run.size(); i++) {
+    run[i] = get<flat_print_t>(Ast[Pos + i]).value;
+  }
+  return run;
+}();
+
 } // namespace brainfuck::flat
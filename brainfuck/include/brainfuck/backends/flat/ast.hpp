@@ -0,0 +1,265 @@
+#pragma once
+
+// Flat AST node definitions, and helpers to go back
+// and forth between the flat representation and a
+// block-level one that is easier to rewrite.
+
+#include <array>
+#include <cstddef>
+#include <variant>
+#include <vector>
+
+#include <brainfuck/ast.hpp>
+
+namespace brainfuck::flat {
+
+using std::size_t;
+
+// ===============================================
+// AST type definitions
+
+/// Represents a single instruction token
+struct flat_token_t {
+  token_t token;
+
+  /// Offset of the accessed cell relative to the
+  /// pointer, for tokens that access a cell
+  std::ptrdiff_t offset = 0;
+};
+
+/// Block descriptor at the beginning of every block
+/// of adjacent instructions.
+struct flat_block_descriptor_t {
+  size_t size;
+};
+
+/// Represents a while instruction, pointing to
+/// another instruction block
+struct flat_while_t {
+  size_t block_begin;
+};
+
+/// Adds a constant to a cell,
+/// ie. a folded run of + and - tokens.
+struct flat_add_t {
+  int value;
+
+  /// Offset of the cell relative to the pointer
+  std::ptrdiff_t offset = 0;
+};
+
+/// Moves the pointer by a constant offset,
+/// ie. a folded run of > and < tokens.
+struct flat_move_t {
+  std::ptrdiff_t offset;
+};
+
+/// Sets a cell to a constant,
+/// ie. a clear loop followed by a flat_add_t.
+struct flat_set_t {
+  int value;
+
+  /// Offset of the cell relative to the pointer
+  std::ptrdiff_t offset = 0;
+};
+
+/// Adds a multiple of the source cell to the cell
+/// at the given offset, ie. one of the updates of a
+/// lowered multiply loop. Both offsets are relative
+/// to the pointer. The target cell is only accessed
+/// if the source cell is not zero, since the original
+/// loop does not run otherwise and the target may be
+/// out of the tape.
+struct flat_mul_add_t {
+  std::ptrdiff_t offset;
+  int factor;
+  std::ptrdiff_t source = 0;
+};
+
+/// Moves the pointer by steps of a constant stride
+/// until it reaches a zero cell, ie. a lowered scan
+/// loop such as [>] or [<<<].
+struct flat_scan_t {
+  std::ptrdiff_t stride;
+};
+
+/// Outputs a constant character, ie. the output of a
+/// cell whose value is known at compile time.
+/// Consecutive flat_print_t nodes are written at once
+/// by the backends.
+struct flat_print_t {
+  char value;
+};
+
+/// Aborts the program if any cell between the given
+/// offsets is out of the tape, see
+/// passes/bounds-checks.hpp. Offsets are relative to
+/// the pointer.
+struct flat_check_t {
+  std::ptrdiff_t min;
+  std::ptrdiff_t max;
+
+  /// If true, the check only applies if the cell at
+  /// the guard offset is not zero
+  bool guarded = false;
+  std::ptrdiff_t guard = 0;
+};
+
+// Superinstructions, see passes/superinstructions.hpp
+
+/// Adds a constant to a cell then moves the pointer,
+/// ie. a flat_add_t followed by a flat_move_t.
+struct flat_add_move_t {
+  int value;
+  std::ptrdiff_t offset;
+  std::ptrdiff_t move;
+};
+
+/// Moves the pointer then sets a cell to a constant,
+/// ie. a flat_move_t followed by a flat_set_t. The
+/// offset is relative to the pointer after the move.
+struct flat_move_set_t {
+  std::ptrdiff_t move;
+  int value;
+  std::ptrdiff_t offset;
+};
+
+/// Adds a multiple of the source cell to a cell then
+/// clears the source cell, ie. a flat_mul_add_t
+/// followed by the flat_set_t that ends a lowered
+/// multiply loop.
+struct flat_mul_add_clear_t {
+  std::ptrdiff_t offset;
+  int factor;
+  std::ptrdiff_t source;
+};
+
+/// Moves the pointer then runs a scan loop, ie. a
+/// flat_move_t followed by a flat_scan_t.
+struct flat_move_scan_t {
+  std::ptrdiff_t move;
+  std::ptrdiff_t stride;
+};
+
+/// Polymorphic representation of a node
+using flat_node_t =
+    std::variant<flat_token_t,
+                 flat_block_descriptor_t,
+                 flat_while_t, flat_add_t,
+                 flat_move_t, flat_set_t,
+                 flat_mul_add_t, flat_scan_t,
+                 flat_print_t, flat_add_move_t,
+                 flat_move_set_t,
+                 flat_mul_add_clear_t,
+                 flat_move_scan_t, flat_check_t>;
+
+/// AST container type
+using flat_ast_t = std::vector<flat_node_t>;
+
+/// NTTP-compatible AST container type. CellSize is
+/// the size of the cells the AST was optimized for,
+/// in bytes, which backends check against the cells
+/// of the state since constant propagation folds
+/// arithmetic modulo the cell size.
+template <size_t N, size_t CellSize = 1>
+struct fixed_flat_ast_t
+    : std::array<flat_node_t, N> {
+  static constexpr size_t cell_size = CellSize;
+};
+
+// ===============================================
+// Block-level representation
+
+/// Flat AST split into its blocks of adjacent
+/// instructions. Block descriptors are omitted,
+/// the root block is the first one, and
+/// flat_while_t::block_begin holds a block index
+/// instead of an instruction position.
+using flat_blocks_t = std::vector<flat_ast_t>;
+
+/// Splits a flat AST into a flat_blocks_t value.
+constexpr flat_blocks_t
+split_blocks(flat_ast_t const &ast) {
+  flat_blocks_t blocks;
+
+  // block_index[p] gives the index of the block
+  // whose descriptor is at position p
+  std::vector<size_t> block_index(ast.size());
+
+  for (size_t pos = 0; pos < ast.size(); pos++) {
+    if (holds_alternative<flat_block_descriptor_t>(
+            ast[pos])) {
+      block_index[pos] = blocks.size();
+      blocks.emplace_back();
+      blocks.back().reserve(
+          get<flat_block_descriptor_t>(ast[pos])
+              .size);
+    } else {
+      blocks.back().push_back(ast[pos]);
+    }
+  }
+
+  // Turning while positions into block indexes
+  for (flat_ast_t &block : blocks) {
+    for (flat_node_t &node : block) {
+      if (holds_alternative<flat_while_t>(node)) {
+        get<flat_while_t>(node).block_begin =
+            block_index[get<flat_while_t>(node)
+                            .block_begin];
+      }
+    }
+  }
+
+  return blocks;
+}
+
+/// Serializes a flat_blocks_t value back into a flat
+/// AST. Blocks that are not reachable from the root
+/// block are dropped.
+constexpr flat_ast_t
+join_blocks(flat_blocks_t const &blocks) {
+  constexpr size_t unvisited = size_t(-1);
+
+  // Listing reachable blocks, root block first
+  std::vector<size_t> order{0};
+  std::vector<size_t> block_pos(blocks.size(),
+                                unvisited);
+  block_pos[0] = 0;
+
+  for (size_t k = 0; k < order.size(); k++) {
+    for (flat_node_t const &node : blocks[order[k]]) {
+      if (holds_alternative<flat_while_t>(node)) {
+        size_t const target =
+            get<flat_while_t>(node).block_begin;
+        if (block_pos[target] == unvisited) {
+          block_pos[target] = 0;
+          order.push_back(target);
+        }
+      }
+    }
+  }
+
+  // Step 1: flattening
+  flat_ast_t serialized_ast;
+  for (size_t block_id : order) {
+    block_pos[block_id] = serialized_ast.size();
+    serialized_ast.push_back(flat_block_descriptor_t{
+        blocks[block_id].size()});
+    for (flat_node_t const &node : blocks[block_id]) {
+      serialized_ast.push_back(node);
+    }
+  }
+
+  // Step 2: linking
+  for (flat_node_t &node : serialized_ast) {
+    if (holds_alternative<flat_while_t>(node)) {
+      get<flat_while_t>(node).block_begin =
+          block_pos[get<flat_while_t>(node)
+                        .block_begin];
+    }
+  }
+
+  return serialized_ast;
+}
+
+} // namespace brainfuck::flat
@@ -0,0 +1,447 @@
+#pragma once
+
+// Runtime flat backend: flat ASTs are compiled into
+// a compact bytecode, which is run by a
+// direct-threaded interpreter. Unlike the other flat
+// backends, programs do not have to be known at
+// compile time.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <span>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <brainfuck/backends/flat.hpp>
+
+namespace brainfuck::flat::bytecode {
+
+/// Bytecode operations. Operands are noted (a, b, c),
+/// and offsets are relative to the pointer.
+enum opcode_t : std::uint8_t {
+  /// Adds a to the cell at offset b
+  op_add_v,
+  /// Moves the pointer by a
+  op_move_v,
+  /// Sets the cell at offset b to a
+  op_set_v,
+  /// Adds b times the cell at offset c to the cell at
+  /// offset a
+  op_mul_add_v,
+  /// Same as op_mul_add_v, then clears the cell at
+  /// offset c
+  op_mul_add_clear_v,
+  /// Moves the pointer by a, then scans with stride b
+  op_scan_v,
+  /// Outputs the cell at offset a
+  op_put_v,
+  /// Reads the cell at offset a from the input
+  op_get_v,
+  /// Outputs b characters of the program text,
+  /// starting at position a
+  op_print_v,
+  /// Adds a to the cell at offset b, then moves the
+  /// pointer by c
+  op_add_move_v,
+  /// Moves the pointer by a, then sets the cell at
+  /// offset c to b
+  op_move_set_v,
+  /// Aborts if the cells between offsets a and b are
+  /// not all in the tape
+  op_check_v,
+  /// Same as op_check_v, if the cell at offset c is
+  /// not zero
+  op_guarded_check_v,
+  /// Jumps to instruction a if the current cell is
+  /// zero, ie. a loop entry
+  op_jump_if_zero_v,
+  /// Jumps to instruction a if the current cell is
+  /// not zero, ie. a loop back edge. b is the number
+  /// of instructions of the loop body
+  op_jump_if_not_zero_v,
+  /// Ends the program
+  op_halt_v,
+};
+
+/// Bytecode instruction. Operands are 32 bits wide,
+/// which is plenty for offsets and jump targets of
+/// programs that fit in memory.
+struct instruction_t {
+  opcode_t opcode;
+  std::int32_t a = 0;
+  std::int32_t b = 0;
+  std::int32_t c = 0;
+};
+
+/// Compiled program.
+struct program_t {
+  std::vector<instruction_t> code;
+
+  /// Constant output, see op_print_v
+  std::string text;
+};
+
+namespace bytecode_impl {
+
+/// Appends the instructions of a block and of the
+/// blocks it contains to a program.
+constexpr void emit_block(flat_blocks_t const &blocks,
+                          size_t block_id,
+                          program_t &program) {
+  std::vector<instruction_t> &code = program.code;
+
+  for (flat_node_t const &node : blocks[block_id]) {
+    if (holds_alternative<flat_token_t>(node)) {
+      flat_token_t const &token =
+          get<flat_token_t>(node);
+      std::int32_t const offset = token.offset;
+      switch (token.token) {
+      case pointer_increase_v:
+        code.push_back({op_move_v, 1});
+        break;
+      case pointer_decrease_v:
+        code.push_back({op_move_v, -1});
+        break;
+      case pointee_increase_v:
+        code.push_back({op_add_v, 1, offset});
+        break;
+      case pointee_decrease_v:
+        code.push_back({op_add_v, -1, offset});
+        break;
+      case put_v:
+        code.push_back({op_put_v, offset});
+        break;
+      case get_v:
+        code.push_back({op_get_v, offset});
+        break;
+      default:
+        break;
+      }
+    }
+
+    else if (holds_alternative<flat_while_t>(node)) {
+      size_t const entry = code.size();
+      code.push_back({op_jump_if_zero_v});
+      emit_block(blocks,
+                 get<flat_while_t>(node).block_begin,
+                 program);
+      code.push_back(
+          {op_jump_if_not_zero_v,
+           std::int32_t(entry + 1),
+           std::int32_t(code.size() - entry)});
+      code[entry].a = std::int32_t(code.size());
+    }
+
+    else if (holds_alternative<flat_add_t>(node)) {
+      flat_add_t const &add = get<flat_add_t>(node);
+      code.push_back({op_add_v, add.value,
+                      std::int32_t(add.offset)});
+    }
+
+    else if (holds_alternative<flat_move_t>(node)) {
+      std::ptrdiff_t const move =
+          get<flat_move_t>(node).offset;
+      code.push_back({op_move_v, std::int32_t(move)});
+    }
+
+    else if (holds_alternative<flat_set_t>(node)) {
+      flat_set_t const &set = get<flat_set_t>(node);
+      code.push_back({op_set_v, set.value,
+                      std::int32_t(set.offset)});
+    }
+
+    else if (holds_alternative<flat_mul_add_t>(
+                 node)) {
+      flat_mul_add_t const &mul_add =
+          get<flat_mul_add_t>(node);
+      code.push_back({op_mul_add_v,
+                      std::int32_t(mul_add.offset),
+                      mul_add.factor,
+                      std::int32_t(mul_add.source)});
+    }
+
+    else if (holds_alternative<flat_scan_t>(node)) {
+      std::ptrdiff_t const stride =
+          get<flat_scan_t>(node).stride;
+      code.push_back(
+          {op_scan_v, 0, std::int32_t(stride)});
+    }
+
+    // Consecutive constant outputs are merged
+    else if (holds_alternative<flat_print_t>(node)) {
+      if (!code.empty() &&
+          code.back().opcode == op_print_v) {
+        code.back().b++;
+      } else {
+        code.push_back(
+            {op_print_v,
+             std::int32_t(program.text.size()), 1});
+      }
+      program.text.push_back(
+          get<flat_print_t>(node).value);
+    }
+
+    else if (holds_alternative<flat_check_t>(node)) {
+      flat_check_t const &check =
+          get<flat_check_t>(node);
+      code.push_back({check.guarded
+                          ? op_guarded_check_v
+                          : op_check_v,
+                      std::int32_t(check.min),
+                      std::int32_t(check.max),
+                      std::int32_t(check.guard)});
+    }
+
+    else if (holds_alternative<flat_add_move_t>(
+                 node)) {
+      flat_add_move_t const &add_move =
+          get<flat_add_move_t>(node);
+      code.push_back({op_add_move_v, add_move.value,
+                      std::int32_t(add_move.offset),
+                      std::int32_t(add_move.move)});
+    }
+
+    else if (holds_alternative<flat_move_set_t>(
+                 node)) {
+      flat_move_set_t const &move_set =
+          get<flat_move_set_t>(node);
+      code.push_back({op_move_set_v,
+                      std::int32_t(move_set.move),
+                      move_set.value,
+                      std::int32_t(move_set.offset)});
+    }
+
+    else if (holds_alternative<flat_mul_add_clear_t>(
+                 node)) {
+      flat_mul_add_clear_t const &mul_add =
+          get<flat_mul_add_clear_t>(node);
+      code.push_back({op_mul_add_clear_v,
+                      std::int32_t(mul_add.offset),
+                      mul_add.factor,
+                      std::int32_t(mul_add.source)});
+    }
+
+    else if (holds_alternative<flat_move_scan_t>(
+                 node)) {
+      flat_move_scan_t const &move_scan =
+          get<flat_move_scan_t>(node);
+      code.push_back(
+          {op_scan_v, std::int32_t(move_scan.move),
+           std::int32_t(move_scan.stride)});
+    }
+  }
+}
+
+} // namespace bytecode_impl
+
+/// Compiles a flat AST into bytecode. Loop jump
+/// targets are resolved at this point.
+constexpr program_t compile(flat_ast_t const &ast) {
+  program_t program;
+  program.code.reserve(ast.size() + 1);
+  bytecode_impl::emit_block(split_blocks(ast), 0,
+                            program);
+  program.code.push_back({op_halt_v});
+  return program;
+}
+
+namespace bytecode_impl {
+
+/// Instruction whose opcode is replaced by the
+/// address of its handler
+struct threaded_t {
+  void *handler;
+  std::int32_t a;
+  std::int32_t b;
+  std::int32_t c;
+};
+
+/// Runs threaded code from instruction pc until the
+/// program halts, or until about budget instructions
+/// have run. The budget is only checked on loop back
+/// edges, where each iteration counts as the size of
+/// the loop body, so that it costs a subtraction per
+/// iteration. pc is updated to the instruction to
+/// resume at, and true is returned if the program has
+/// halted.
+///
+/// When code is nullptr, nothing is run and the
+/// handler table is stored in handlers instead, which
+/// is how programs are translated into threaded code.
+/// Relies on the labels as values extension of GCC
+/// and Clang.
+template <typename State>
+bool interpret(threaded_t const *code,
+               char const *text, State *s,
+               std::size_t &pc, std::ptrdiff_t budget,
+               void *const **handlers = nullptr) {
+  // Must follow the order of opcode_t
+  static void *const table[] = {
+      &&add,           &&move,
+      &&set,           &&mul_add,
+      &&mul_add_clear, &&scan,
+      &&put,           &&get,
+      &&print,         &&add_move,
+      &&move_set,      &&check,
+      &&guarded_check, &&jump_if_zero,
+      &&jump_if_not_zero, &&halt,
+  };
+
+  if (code == nullptr) {
+    *handlers = table;
+    return false;
+  }
+
+  threaded_t const *ip = code + pc;
+  auto *const tape = s->data.data();
+  std::size_t const size = s->data.size();
+  std::size_t i = s->i;
+
+  goto *ip->handler;
+
+add:
+  tape[i + ip->b] += ip->a;
+  goto *(++ip)->handler;
+
+move:
+  i += ip->a;
+  goto *(++ip)->handler;
+
+set:
+  tape[i + ip->b] = ip->a;
+  goto *(++ip)->handler;
+
+mul_add:
+  if (tape[i + ip->c] != 0) {
+    tape[i + ip->a] += ip->b * tape[i + ip->c];
+  }
+  goto *(++ip)->handler;
+
+mul_add_clear:
+  if (tape[i + ip->c] != 0) {
+    tape[i + ip->a] += ip->b * tape[i + ip->c];
+    tape[i + ip->c] = 0;
+  }
+  goto *(++ip)->handler;
+
+scan:
+  i = flat::scan(std::span(tape, size), i + ip->a,
+                 ip->b);
+  goto *(++ip)->handler;
+
+put:
+  output_char(*s, tape[i + ip->a]);
+  goto *(++ip)->handler;
+
+get:
+  tape[i + ip->a] = input_char(*s);
+  goto *(++ip)->handler;
+
+print:
+  output_text(*s, text + ip->a, ip->b);
+  goto *(++ip)->handler;
+
+add_move:
+  tape[i + ip->b] += ip->a;
+  i += ip->c;
+  goto *(++ip)->handler;
+
+move_set:
+  i += ip->a;
+  tape[i + ip->c] = ip->b;
+  goto *(++ip)->handler;
+
+guarded_check:
+  if (tape[i + ip->c] == 0) {
+    goto *(++ip)->handler;
+  }
+
+check:
+  if (i + ip->a >= size || i + ip->b >= size)
+      [[unlikely]] {
+    out_of_tape(*s, i);
+  }
+  goto *(++ip)->handler;
+
+jump_if_zero:
+  ip = tape[i] == 0 ? code + ip->a : ip + 1;
+  goto *ip->handler;
+
+jump_if_not_zero:
+  budget -= ip->b;
+  ip = tape[i] != 0 ? code + ip->a : ip + 1;
+  if (budget <= 0) [[unlikely]] {
+    goto suspend;
+  }
+  goto *ip->handler;
+
+suspend:
+  s->i = i;
+  pc = ip - code;
+  return false;
+
+halt:
+  s->i = i;
+  pc = ip - code;
+  return true;
+}
+
+} // namespace bytecode_impl
+
+/// Compiled program translated into threaded code for
+/// a given state type: each instruction holds the
+/// address of its handler, so that handlers dispatch
+/// the next instruction with a single indirect jump.
+/// Threaded programs can be run in slices, see
+/// run_slice.
+template <typename State> class threaded_program_t {
+public:
+  explicit threaded_program_t(
+      program_t const &program)
+      : text_(program.text) {
+    void *const *handlers;
+    std::size_t pc = 0;
+    bytecode_impl::interpret<State>(nullptr, nullptr,
+                                    nullptr, pc, 0,
+                                    &handlers);
+
+    code_.reserve(program.code.size());
+    for (instruction_t const &instr : program.code) {
+      code_.push_back({handlers[instr.opcode],
+                       instr.a, instr.b, instr.c});
+    }
+  }
+
+  /// Runs the program from instruction pc for about
+  /// budget instructions, see
+  /// bytecode_impl::interpret. Returns true if the
+  /// program has halted, otherwise it can be resumed
+  /// at pc.
+  bool run_slice(State &s, std::size_t &pc,
+                 std::ptrdiff_t budget) const {
+    return bytecode_impl::interpret(
+        code_.data(), text_.data(), &s, pc, budget);
+  }
+
+  /// Runs the program until it halts.
+  void run(State &s) const {
+    std::size_t pc = 0;
+    while (!run_slice(s, pc, PTRDIFF_MAX)) {
+    }
+  }
+
+private:
+  std::vector<bytecode_impl::threaded_t> code_;
+  std::string text_;
+};
+
+/// Runs a compiled program.
+void run(program_t const &program, auto &s) {
+  using state_t =
+      std::remove_reference_t<decltype(s)>;
+  threaded_program_t<state_t>(program).run(s);
+}
+
+} // namespace brainfuck::flat::bytecode
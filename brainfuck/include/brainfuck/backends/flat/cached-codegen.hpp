@@ -0,0 +1,378 @@
+#pragma once
+
+// Flat backend that keeps the pointer and the current
+// cell in local variables instead of going through
+// the program state on every instruction. The cached
+// cell is written back to the tape only before the
+// pointer moves or the tape is scanned, and reloaded
+// right after, or after the bounds check that follows
+// the move if there is one.
+
+#include <brainfuck/backends/flat.hpp>
+
+namespace brainfuck::flat::cached {
+
+/// Cached part of the program state. Cell stores can
+/// alias program_state_t::i, so keeping the pointer
+/// in a local is what allows the compiler to keep
+/// both values in registers.
+template <typename Cell> struct cache_t {
+  std::size_t i;
+  Cell cell;
+};
+
+/// Returns a reference to the cell at the given
+/// offset, ie. the cached current cell if the offset
+/// is 0, or a tape cell otherwise.
+template <std::ptrdiff_t Offset>
+constexpr auto &cell_at(auto &s, auto &c) {
+  if constexpr (Offset == 0) {
+    return c.cell;
+  } else {
+    return s.data[c.i + Offset];
+  }
+}
+
+/// Moves the pointer, spilling and reloading the
+/// cached cell.
+template <std::ptrdiff_t Move, bool Reload = true>
+constexpr void move(auto &s, auto &c) {
+  s.data[c.i] = c.cell;
+  c.i += Move;
+  if constexpr (Reload) {
+    c.cell = s.data[c.i];
+  }
+}
+
+/// Runs a scan loop after moving the pointer,
+/// spilling and reloading the cached cell.
+template <std::ptrdiff_t Stride,
+          std::ptrdiff_t Move = 0, bool Reload = true>
+constexpr void scan_from(auto &s, auto &c) {
+  s.data[c.i] = c.cell;
+  c.i = scan<Stride>(s.data, c.i + Move);
+  if constexpr (Reload) {
+    c.cell = s.data[c.i];
+  }
+}
+
+/// Returns true if the node at position pos moves
+/// the pointer and is directly followed by a bounds
+/// check. The cached cell is then reloaded by the
+/// check instead, so that it is not read before
+/// being checked.
+constexpr bool defers_reload(auto const &ast,
+                             size_t pos) {
+  if (pos >= ast.size() || pos + 1 >= ast.size() ||
+      !holds_alternative<flat_check_t>(
+          ast[pos + 1])) {
+    return false;
+  }
+
+  flat_node_t const &node = ast[pos];
+  if (holds_alternative<flat_token_t>(node)) {
+    token_t const token =
+        get<flat_token_t>(node).token;
+    return token == pointer_increase_v ||
+           token == pointer_decrease_v;
+  }
+  return holds_alternative<flat_move_t>(node) ||
+         holds_alternative<flat_scan_t>(node) ||
+         holds_alternative<flat_add_move_t>(node) ||
+         holds_alternative<flat_move_scan_t>(node);
+}
+
+/// Generates code for a node of a fixed_flat_ast_t.
+/// The generated functions take the program state
+/// along with the cached values, and return their
+/// updated version. Passing them by value lets them
+/// live in registers across calls that are not
+/// inlined.
+template <auto const &Ast, size_t InstructionPos>
+constexpr auto node_codegen() {
+  constexpr flat_node_t Instr = Ast[InstructionPos];
+  constexpr bool Reload =
+      !defers_reload(Ast, InstructionPos);
+
+  /// Single instruction
+  if constexpr (holds_alternative<flat_token_t>(
+                    Instr)) {
+    constexpr flat_token_t Token =
+        get<flat_token_t>(Instr);
+    constexpr std::ptrdiff_t Offset = Token.offset;
+
+    if constexpr (Token.token == pointer_increase_v) {
+      return [](auto &s, auto c) {
+        move<1, Reload>(s, c);
+        return c;
+      };
+    } else if constexpr (Token.token ==
+                         pointer_decrease_v) {
+      return [](auto &s, auto c) {
+        move<-1, Reload>(s, c);
+        return c;
+      };
+    } else if constexpr (Token.token ==
+                         pointee_increase_v) {
+      return [](auto &s, auto c) {
+        cell_at<Offset>(s, c)++;
+        return c;
+      };
+    } else if constexpr (Token.token ==
+                         pointee_decrease_v) {
+      return [](auto &s, auto c) {
+        cell_at<Offset>(s, c)--;
+        return c;
+      };
+    } else if constexpr (Token.token == put_v) {
+      return [](auto &s, auto c) {
+        output_char(s, cell_at<Offset>(s, c));
+        return c;
+      };
+    } else if constexpr (Token.token == get_v) {
+      return [](auto &s, auto c) {
+        cell_at<Offset>(s, c) = input_char(s);
+        return c;
+      };
+    }
+  }
+
+  /// Block of code, the cached values are kept
+  /// across the whole block
+  else if constexpr (holds_alternative<
+                         flat_block_descriptor_t>(
+                         Instr)) {
+    constexpr flat_block_descriptor_t
+        BlockDescriptor =
+            get<flat_block_descriptor_t>(Instr);
+    return [](auto &s, auto c) {
+      [&]<size_t... InstructionIDs>(
+          std::index_sequence<InstructionIDs...>) {
+        ((c = node_codegen<Ast, 1 + InstructionPos +
+                                   InstructionIDs>()(
+              s, c)),
+         ...);
+      }(std::make_index_sequence<
+          BlockDescriptor.size>{});
+      return c;
+    };
+  }
+
+  /// While loop, the guard is the cached cell
+  else if constexpr (holds_alternative<flat_while_t>(
+                         Instr)) {
+    constexpr size_t BlockBegin =
+        get<flat_while_t>(Instr).block_begin;
+    return [](auto &s, auto c) {
+      while (c.cell) {
+        c = node_codegen<Ast, BlockBegin>()(s, c);
+      }
+      return c;
+    };
+  }
+
+  /// Folded cell increment
+  else if constexpr (holds_alternative<flat_add_t>(
+                         Instr)) {
+    constexpr int Value =
+        get<flat_add_t>(Instr).value;
+    constexpr std::ptrdiff_t Offset =
+        get<flat_add_t>(Instr).offset;
+    return [](auto &s, auto c) {
+      cell_at<Offset>(s, c) += Value;
+      return c;
+    };
+  }
+
+  /// Folded pointer move
+  else if constexpr (holds_alternative<flat_move_t>(
+                         Instr)) {
+    constexpr std::ptrdiff_t Move =
+        get<flat_move_t>(Instr).offset;
+    return [](auto &s, auto c) {
+      move<Move, Reload>(s, c);
+      return c;
+    };
+  }
+
+  /// Cell store
+  else if constexpr (holds_alternative<flat_set_t>(
+                         Instr)) {
+    constexpr int Value =
+        get<flat_set_t>(Instr).value;
+    constexpr std::ptrdiff_t Offset =
+        get<flat_set_t>(Instr).offset;
+    return [](auto &s, auto c) {
+      cell_at<Offset>(s, c) = Value;
+      return c;
+    };
+  }
+
+  /// Multiply loop update
+  else if constexpr (
+      holds_alternative<flat_mul_add_t>(Instr)) {
+    constexpr std::ptrdiff_t Offset =
+        get<flat_mul_add_t>(Instr).offset;
+    constexpr int Factor =
+        get<flat_mul_add_t>(Instr).factor;
+    constexpr std::ptrdiff_t Source =
+        get<flat_mul_add_t>(Instr).source;
+    return [](auto &s, auto c) {
+      if (cell_at<Source>(s, c) != 0) {
+        cell_at<Offset>(s, c) +=
+            Factor * cell_at<Source>(s, c);
+      }
+      return c;
+    };
+  }
+
+  /// Scan loop
+  else if constexpr (holds_alternative<flat_scan_t>(
+                         Instr)) {
+    constexpr std::ptrdiff_t Stride =
+        get<flat_scan_t>(Instr).stride;
+    return [](auto &s, auto c) {
+      scan_from<Stride, 0, Reload>(s, c);
+      return c;
+    };
+  }
+
+  /// Constant output, written once per run of
+  /// consecutive flat_print_t nodes
+  else if constexpr (holds_alternative<flat_print_t>(
+                         Instr)) {
+    if constexpr (
+        continues_print_run<Ast, InstructionPos>()) {
+      return
+          [](auto &, auto c) { return c; };
+    } else {
+      return [](auto &s, auto c) {
+        constexpr auto const &Run =
+            print_run<Ast, InstructionPos>;
+        output_text(s, Run.data(), Run.size());
+        return c;
+      };
+    }
+  }
+
+  /// Tape bounds check, which reloads the cached
+  /// cell if the previous node did not
+  else if constexpr (holds_alternative<flat_check_t>(
+                         Instr)) {
+    constexpr std::ptrdiff_t Min =
+        get<flat_check_t>(Instr).min;
+    constexpr std::ptrdiff_t Max =
+        get<flat_check_t>(Instr).max;
+    constexpr bool Guarded =
+        get<flat_check_t>(Instr).guarded;
+    constexpr std::ptrdiff_t Guard =
+        get<flat_check_t>(Instr).guard;
+    constexpr bool ReloadCell =
+        defers_reload(Ast, InstructionPos - 1);
+    return [](auto &s, auto c) {
+      // Guards are in the tape, but the cached cell
+      // may not be loaded yet
+      if constexpr (ReloadCell) {
+        if (Guarded && s.data[c.i + Guard] == 0) {
+          c.cell = s.data[c.i];
+          return c;
+        }
+      } else if constexpr (Guarded) {
+        if (cell_at<Guard>(s, c) == 0) {
+          return c;
+        }
+      }
+      if (c.i + Min >= s.data.size() ||
+          c.i + Max >= s.data.size()) [[unlikely]] {
+        out_of_tape(s, c.i);
+      }
+      if constexpr (ReloadCell) {
+        c.cell = s.data[c.i];
+      }
+      return c;
+    };
+  }
+
+  /// Superinstruction: cell increment then move
+  else if constexpr (
+      holds_alternative<flat_add_move_t>(Instr)) {
+    constexpr int Value =
+        get<flat_add_move_t>(Instr).value;
+    constexpr std::ptrdiff_t Offset =
+        get<flat_add_move_t>(Instr).offset;
+    constexpr std::ptrdiff_t Move =
+        get<flat_add_move_t>(Instr).move;
+    return [](auto &s, auto c) {
+      cell_at<Offset>(s, c) += Value;
+      move<Move, Reload>(s, c);
+      return c;
+    };
+  }
+
+  /// Superinstruction: move then cell store
+  else if constexpr (
+      holds_alternative<flat_move_set_t>(Instr)) {
+    constexpr std::ptrdiff_t Move =
+        get<flat_move_set_t>(Instr).move;
+    constexpr int Value =
+        get<flat_move_set_t>(Instr).value;
+    constexpr std::ptrdiff_t Offset =
+        get<flat_move_set_t>(Instr).offset;
+    return [](auto &s, auto c) {
+      move<Move>(s, c);
+      cell_at<Offset>(s, c) = Value;
+      return c;
+    };
+  }
+
+  /// Superinstruction: multiply loop update then
+  /// source clear
+  else if constexpr (
+      holds_alternative<flat_mul_add_clear_t>(
+          Instr)) {
+    constexpr std::ptrdiff_t Offset =
+        get<flat_mul_add_clear_t>(Instr).offset;
+    constexpr int Factor =
+        get<flat_mul_add_clear_t>(Instr).factor;
+    constexpr std::ptrdiff_t Source =
+        get<flat_mul_add_clear_t>(Instr).source;
+    return [](auto &s, auto c) {
+      if (cell_at<Source>(s, c) != 0) {
+        cell_at<Offset>(s, c) +=
+            Factor * cell_at<Source>(s, c);
+        cell_at<Source>(s, c) = 0;
+      }
+      return c;
+    };
+  }
+
+  /// Superinstruction: move then scan loop
+  else if constexpr (holds_alternative<
+                         flat_move_scan_t>(Instr)) {
+    constexpr std::ptrdiff_t Move =
+        get<flat_move_scan_t>(Instr).move;
+    constexpr std::ptrdiff_t Stride =
+        get<flat_move_scan_t>(Instr).stride;
+    return [](auto &s, auto c) {
+      scan_from<Stride, Move, Reload>(s, c);
+      return c;
+    };
+  }
+}
+
+/// Generates a program from a fixed_flat_ast_t
+template <auto const &Ast>
+constexpr auto codegen() {
+  return [](auto &s) {
+    static_assert(sizeof(s.data[0]) == Ast.cell_size,
+                  "state and AST cell sizes differ");
+    using cell_t =
+        std::remove_cvref_t<decltype(s.data[0])>;
+    cache_t<cell_t> const c = node_codegen<Ast, 0>()(
+        s, cache_t<cell_t>{s.i, s.data[s.i]});
+    s.data[c.i] = c.cell;
+    s.i = c.i;
+  };
+}
+
+} // namespace brainfuck::flat::cached
@@ -0,0 +1,287 @@
+#pragma once
+
+// Ahead-of-time flat backend: flat ASTs are emitted
+// as plain C++ source code with a single function of
+// straight-line code and while loops. The generated
+// code does not depend on this library, so large
+// programs can be compiled without going through
+// template instantiation.
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+#include <brainfuck/backends/flat.hpp>
+
+namespace brainfuck::flat::cpp_emitter {
+
+namespace cpp_emitter_impl {
+
+/// Returns the expression of the pointer plus an
+/// offset.
+inline std::string index(std::ptrdiff_t offset) {
+  if (offset == 0) {
+    return "i";
+  }
+  if (offset > 0) {
+    return "i + " + std::to_string(offset);
+  }
+  return "i - " + std::to_string(-offset);
+}
+
+/// Returns the tape access expression for the cell at
+/// an offset from the pointer.
+inline std::string cell(std::ptrdiff_t offset) {
+  return "data[" + index(offset) + "]";
+}
+
+/// Returns the statement that moves the pointer.
+inline std::string move(std::ptrdiff_t offset) {
+  if (offset >= 0) {
+    return "i += " + std::to_string(offset) + ";\n";
+  }
+  return "i -= " + std::to_string(-offset) + ";\n";
+}
+
+/// Returns the C++ string literal of a text.
+inline std::string
+string_literal(std::string_view text) {
+  static constexpr char digits[] = "01234567";
+
+  std::string literal = "\"";
+  for (char c : text) {
+    unsigned char const u = c;
+    if (c == '"' || c == '\\') {
+      literal += '\\';
+      literal += c;
+    } else if (u >= ' ' && u < 0x7f) {
+      literal += c;
+    }
+
+    // Octal escapes have a fixed width so that they
+    // cannot absorb the characters that follow them
+    else {
+      literal += '\\';
+      literal += digits[u >> 6];
+      literal += digits[(u >> 3) & 7];
+      literal += digits[u & 7];
+    }
+  }
+  return literal + '"';
+}
+
+/// Appends the code of a block and of the blocks it
+/// contains to the output.
+inline void emit_block(flat_blocks_t const &blocks,
+                       size_t block_id, size_t depth,
+                       std::string &out) {
+  std::string const indent(2 * depth, ' ');
+  std::string text;
+
+  // Writes the pending constant output
+  auto const flush_text = [&]() {
+    if (!text.empty()) {
+      out += indent + "std::fwrite(" +
+             string_literal(text) + ", 1, " +
+             std::to_string(text.size()) +
+             ", stdout);\n";
+      text.clear();
+    }
+  };
+
+  for (flat_node_t const &node : blocks[block_id]) {
+    // Consecutive constant outputs are merged
+    if (holds_alternative<flat_print_t>(node)) {
+      text += get<flat_print_t>(node).value;
+      continue;
+    }
+    flush_text();
+
+    if (holds_alternative<flat_token_t>(node)) {
+      flat_token_t const &token =
+          get<flat_token_t>(node);
+      std::string const c = cell(token.offset);
+      switch (token.token) {
+      case pointer_increase_v:
+        out += indent + "++i;\n";
+        break;
+      case pointer_decrease_v:
+        out += indent + "--i;\n";
+        break;
+      case pointee_increase_v:
+        out += indent + c + "++;\n";
+        break;
+      case pointee_decrease_v:
+        out += indent + c + "--;\n";
+        break;
+      case put_v:
+        out += indent + "std::putchar(" + c + ");\n";
+        break;
+      case get_v:
+        out += indent + c + " = std::getchar();\n";
+        break;
+      default:
+        break;
+      }
+    }
+
+    else if (holds_alternative<flat_while_t>(node)) {
+      out += indent + "while (data[i]) {\n";
+      emit_block(blocks,
+                 get<flat_while_t>(node).block_begin,
+                 depth + 1, out);
+      out += indent + "}\n";
+    }
+
+    else if (holds_alternative<flat_add_t>(node)) {
+      flat_add_t const &add = get<flat_add_t>(node);
+      out += indent + cell(add.offset) + " += " +
+             std::to_string(add.value) + ";\n";
+    }
+
+    else if (holds_alternative<flat_move_t>(node)) {
+      out += indent +
+             move(get<flat_move_t>(node).offset);
+    }
+
+    else if (holds_alternative<flat_set_t>(node)) {
+      flat_set_t const &set = get<flat_set_t>(node);
+      out += indent + cell(set.offset) + " = " +
+             std::to_string(set.value) + ";\n";
+    }
+
+    else if (holds_alternative<flat_mul_add_t>(
+                 node)) {
+      flat_mul_add_t const &mul_add =
+          get<flat_mul_add_t>(node);
+      out += indent + "if (" + cell(mul_add.source) +
+             ") {\n" + indent + "  " +
+             cell(mul_add.offset) + " += " +
+             std::to_string(mul_add.factor) + " * " +
+             cell(mul_add.source) + ";\n" + indent +
+             "}\n";
+    }
+
+    else if (holds_alternative<flat_scan_t>(node)) {
+      std::ptrdiff_t const stride =
+          get<flat_scan_t>(node).stride;
+      out += indent + "while (data[i]) {\n" + indent +
+             "  " + move(stride) + indent + "}\n";
+    }
+
+    else if (holds_alternative<flat_check_t>(node)) {
+      flat_check_t const &check =
+          get<flat_check_t>(node);
+      std::string condition =
+          index(check.min) + " >= size || " +
+          index(check.max) + " >= size";
+      if (check.guarded) {
+        condition = cell(check.guard) + " && (" +
+                    condition + ")";
+      }
+      out += indent + "if (" + condition + ") {\n" +
+             indent + "  out_of_tape(i);\n" + indent +
+             "}\n";
+    }
+
+    else if (holds_alternative<flat_add_move_t>(
+                 node)) {
+      flat_add_move_t const &add_move =
+          get<flat_add_move_t>(node);
+      out += indent + cell(add_move.offset) + " += " +
+             std::to_string(add_move.value) + ";\n" +
+             indent + move(add_move.move);
+    }
+
+    else if (holds_alternative<flat_move_set_t>(
+                 node)) {
+      flat_move_set_t const &move_set =
+          get<flat_move_set_t>(node);
+      out += indent + move(move_set.move) + indent +
+             cell(move_set.offset) + " = " +
+             std::to_string(move_set.value) + ";\n";
+    }
+
+    else if (holds_alternative<flat_mul_add_clear_t>(
+                 node)) {
+      flat_mul_add_clear_t const &mul_add =
+          get<flat_mul_add_clear_t>(node);
+      out += indent + "if (" + cell(mul_add.source) +
+             ") {\n" + indent + "  " +
+             cell(mul_add.offset) + " += " +
+             std::to_string(mul_add.factor) + " * " +
+             cell(mul_add.source) + ";\n" + indent +
+             "  " + cell(mul_add.source) + " = 0;\n" +
+             indent + "}\n";
+    }
+
+    else if (holds_alternative<flat_move_scan_t>(
+                 node)) {
+      flat_move_scan_t const &move_scan =
+          get<flat_move_scan_t>(node);
+      out += indent + move(move_scan.move) + indent +
+             "while (data[i]) {\n" + indent + "  " +
+             move(move_scan.stride) + indent + "}\n";
+    }
+  }
+
+  flush_text();
+}
+
+/// Returns the declaration of a generated function.
+inline std::string signature(std::string_view name) {
+  return "std::size_t " + std::string(name) +
+         "(char *data, std::size_t size,\n"
+         "    std::size_t i)";
+}
+
+} // namespace cpp_emitter_impl
+
+/// Returns the header that declares the function
+/// generated by emit_source. The function runs the
+/// program on a tape of the given size, starting at
+/// pointer i, and returns the final pointer.
+inline std::string
+emit_header(std::string_view name) {
+  return "#pragma once\n"
+         "\n"
+         "#include <cstddef>\n"
+         "\n" +
+         cpp_emitter_impl::signature(name) +
+         ";\n";
+}
+
+/// Returns the C++ source of a function named name
+/// that runs a flat AST.
+inline std::string
+emit_source(flat_ast_t const &ast,
+            std::string_view name) {
+  std::string out = R"(// Generated from a BF program
+
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+
+namespace {
+
+[[noreturn, maybe_unused]] void
+out_of_tape(std::size_t i) {
+  std::fflush(stdout);
+  std::fprintf(stderr,
+               "brainfuck: tape access out of "
+               "bounds (pointer: %td)\n",
+               std::ptrdiff_t(i));
+  std::abort();
+}
+
+} // namespace
+
+)" +
+      cpp_emitter_impl::signature(name) + " {\n"
+      "  (void)size;\n";
+  cpp_emitter_impl::emit_block(split_blocks(ast), 0,
+                               1, out);
+  return out + "  return i;\n}\n";
+}
+
+} // namespace brainfuck::flat::cpp_emitter
@@ -0,0 +1,220 @@
+#pragma once
+
+// Flat backend that spends a fixed instantiation
+// budget on the loops that carry most of the run
+// time. Innermost and shortest loops are generated
+// with the monolithic backend until the budget is
+// exhausted, and the rest of the program runs on the
+// function pointer table of the table backend.
+// Compile time is therefore bounded by the budget
+// rather than by the size of the program.
+
+#include <algorithm>
+#include <array>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <brainfuck/backends/flat/linear-program.hpp>
+#include <brainfuck/backends/flat/monolithic-codegen.hpp>
+#include <brainfuck/backends/flat/table-codegen.hpp>
+
+namespace brainfuck::flat::hybrid {
+
+/// Default number of flat nodes generated with the
+/// monolithic backend
+inline constexpr size_t default_budget = 512;
+
+namespace hybrid_impl {
+
+/// Loop candidate for code generation
+struct loop_t {
+  /// Index of the body in split_blocks
+  size_t block;
+
+  /// Number of nodes of the loop, nested loops
+  /// included
+  size_t size;
+
+  /// Nesting depth
+  size_t depth;
+};
+
+/// Returns the number of nodes of a block and of the
+/// blocks it contains, except for blocks that are
+/// already generated.
+constexpr size_t
+uncovered_size(flat_blocks_t const &blocks,
+               size_t block_id,
+               std::vector<bool> const &generated) {
+  size_t size = blocks[block_id].size();
+  for (flat_node_t const &node : blocks[block_id]) {
+    if (holds_alternative<flat_while_t>(node)) {
+      size_t const body =
+          get<flat_while_t>(node).block_begin;
+      if (!generated[body]) {
+        size +=
+            uncovered_size(blocks, body, generated);
+      }
+    }
+  }
+  return size;
+}
+
+/// Appends the loops of a block and of the blocks it
+/// contains to loops, and returns the number of
+/// nodes of the block, nested blocks included.
+constexpr size_t
+collect_loops(flat_blocks_t const &blocks,
+              size_t block_id, size_t depth,
+              std::vector<loop_t> &loops) {
+  size_t size = blocks[block_id].size();
+  for (flat_node_t const &node : blocks[block_id]) {
+    if (holds_alternative<flat_while_t>(node)) {
+      size_t const body =
+          get<flat_while_t>(node).block_begin;
+      size_t const loop_size = collect_loops(
+          blocks, body, depth + 1, loops);
+      loops.push_back({body, loop_size, depth + 1});
+      size += loop_size;
+    }
+  }
+  return size;
+}
+
+/// Selects the loops to generate with the monolithic
+/// backend, and returns whether each block of
+/// split_blocks is the body of a selected loop.
+/// Loops are considered from the shortest to the
+/// longest, and from the innermost to the outermost
+/// for equal sizes. A loop costs its nodes minus the
+/// ones of the selected loops it contains, as their
+/// code is reused.
+constexpr std::vector<bool>
+select_loops(flat_ast_t const &ast, size_t budget) {
+  flat_blocks_t const blocks = split_blocks(ast);
+
+  std::vector<loop_t> loops;
+  collect_loops(blocks, 0, 0, loops);
+  std::ranges::sort(loops, [](loop_t const &a,
+                              loop_t const &b) {
+    return a.size != b.size ? a.size < b.size
+                            : a.depth > b.depth;
+  });
+
+  std::vector<bool> generated(blocks.size());
+  size_t spent = 0;
+  for (loop_t const &loop : loops) {
+    size_t const cost =
+        uncovered_size(blocks, loop.block, generated);
+    if (spent + cost <= budget) {
+      generated[loop.block] = true;
+      spent += cost;
+    }
+  }
+  return generated;
+}
+
+/// Linearized version of a fixed_flat_ast_t where
+/// the selected loops are kept whole.
+template <auto const &Ast, size_t Budget>
+inline constexpr auto program = [] {
+  auto const linearized = [] {
+    flat_ast_t const ast(Ast.begin(), Ast.end());
+    return linear::linearize(
+        ast, select_loops(ast, Budget));
+  };
+  constexpr size_t CodeSize =
+      linearized().code.size();
+  constexpr size_t TextSize =
+      linearized().text.size();
+
+  linear::fixed_program_t<CodeSize, TextSize> fixed;
+  linear::program_t const result = linearized();
+  std::ranges::copy(result.code, fixed.code.begin());
+  std::ranges::copy(result.text, fixed.text.begin());
+  return fixed;
+}();
+
+/// Returns the AST position of the descriptor of a
+/// block of split_blocks.
+template <auto const &Ast>
+constexpr size_t block_position(size_t block_id) {
+  for (size_t pos = 0; pos < Ast.size(); pos++) {
+    if (holds_alternative<flat_block_descriptor_t>(
+            Ast[pos]) &&
+        block_id-- == 0) {
+      return pos;
+    }
+  }
+  return Ast.size();
+}
+
+/// Runs a loop generated with the monolithic
+/// backend, which never jumps.
+template <typename State, auto const &Ast,
+          size_t BodyPos>
+bool run_loop(State &s) {
+  while (s.data[s.i]) {
+    monolithic::codegen<Ast, BodyPos>()(s);
+  }
+  return false;
+}
+
+/// Returns the handler of an instruction.
+template <typename State, auto const &Ast,
+          auto const &Program, size_t Pos>
+constexpr auto handler() -> bool (*)(State &) {
+  constexpr linear::instruction_t const &Instr =
+      Program.code[Pos];
+
+  if constexpr (Instr.kind == linear::loop_v) {
+    constexpr size_t BodyPos = block_position<Ast>(
+        get<flat_while_t>(Instr.node).block_begin);
+    return &run_loop<State, Ast, BodyPos>;
+  } else {
+    return table::table_impl::handler<State, Program,
+                                      Pos>();
+  }
+}
+
+/// Dispatch table of a linearized program.
+template <typename State, auto const &Ast,
+          auto const &Program>
+inline constexpr auto dispatch_table =
+    []<size_t... Pos>(std::index_sequence<Pos...>) {
+      return std::array<table::table_impl::entry_t<
+                            State>,
+                        sizeof...(Pos)>{
+          table::table_impl::entry_t<State>{
+              handler<State, Ast, Program, Pos>(),
+              Program.code[Pos].jump}...};
+    }(std::make_index_sequence<
+        Program.code.size()>{});
+
+} // namespace hybrid_impl
+
+/// Generates a program from a fixed_flat_ast_t,
+/// generating at most Budget nodes with the
+/// monolithic backend.
+template <auto const &Ast,
+          size_t Budget = default_budget>
+constexpr auto codegen() {
+  return [](auto &s) {
+    static_assert(sizeof(s.data[0]) == Ast.cell_size,
+                  "state and AST cell sizes differ");
+    using state_t =
+        std::remove_reference_t<decltype(s)>;
+    constexpr auto const &Table =
+        hybrid_impl::dispatch_table<
+            state_t, Ast,
+            hybrid_impl::program<Ast, Budget>>;
+
+    for (size_t pc = 0; pc < Table.size();) {
+      pc = Table[pc].handler(s) ? Table[pc].jump
+                                : pc + 1;
+    }
+  };
+}
+
+} // namespace brainfuck::flat::hybrid
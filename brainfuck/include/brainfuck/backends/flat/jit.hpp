@@ -0,0 +1,539 @@
+#pragma once
+
+// x86-64 JIT backend: flat ASTs are compiled into
+// machine code at runtime, in a buffer that is
+// mapped writable while the code is emitted, then
+// executable. The tape base, the pointer and the
+// tape size are pinned to callee-saved registers,
+// loops become native compare-and-branch
+// instructions, and scans are calls to regular
+// functions. I/O goes through a table of functions
+// that forward to the IO policy of the state, see
+// io_t.
+
+#if defined(__x86_64__) && defined(__unix__)
+
+/// Defined if the JIT supports the target
+#define BRAINFUCK_HAS_JIT
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <initializer_list>
+#include <memory>
+#include <new>
+#include <span>
+#include <string>
+#include <vector>
+
+#include <sys/mman.h>
+
+#include <brainfuck/backends/flat.hpp>
+
+namespace brainfuck::flat::jit {
+
+namespace jit_impl {
+
+/// Functions through which the generated code
+/// accesses the state. The generated code keeps a
+/// pointer to the table in r14, and passes the state
+/// as the first argument of every call.
+struct io_t {
+  void *state;
+  void (*put)(void *, char);
+  char (*get)(void *);
+  void (*print)(void *, char const *, std::size_t);
+  void (*fail)(void *, std::size_t);
+};
+
+// Byte offsets of the members of io_t, for the
+// generated code
+inline constexpr std::int8_t io_state_v = 0;
+inline constexpr std::int8_t io_put_v = 8;
+inline constexpr std::int8_t io_get_v = 16;
+inline constexpr std::int8_t io_print_v = 24;
+inline constexpr std::int8_t io_fail_v = 32;
+
+// Functions called by the generated code
+
+template <typename State>
+void put_cell(void *s, char c) {
+  output_char(*static_cast<State *>(s), c);
+}
+
+template <typename State> char get_cell(void *s) {
+  return char(input_char(*static_cast<State *>(s)));
+}
+
+template <typename State>
+void print_text(void *s, char const *text,
+                std::size_t size) {
+  output_text(*static_cast<State *>(s), text, size);
+}
+
+template <typename State>
+[[noreturn]] void fail_out_of_tape(void *s,
+                                   std::size_t i) {
+  out_of_tape(*static_cast<State *>(s), i);
+}
+
+inline std::size_t scan_tape(char const *tape,
+                             std::size_t i,
+                             std::size_t size,
+                             std::ptrdiff_t stride) {
+  return scan(std::span<char const>(tape, size), i,
+              stride);
+}
+
+// Condition codes of conditional jumps
+inline constexpr std::uint8_t above_or_equal_v = 0x3;
+inline constexpr std::uint8_t equal_v = 0x4;
+inline constexpr std::uint8_t not_equal_v = 0x5;
+
+/// Machine code emitter. Register usage:
+///  - rbx: tape base
+///  - r12: pointer, ie. index of the current cell
+///  - r13: tape size
+///  - r14: I/O table, see io_t
+/// All four are callee-saved, so they survive calls.
+struct assembler_t {
+  std::vector<std::uint8_t> code;
+
+  void
+  emit(std::initializer_list<std::uint8_t> bytes) {
+    code.insert(code.end(), bytes);
+  }
+
+  void emit_imm32(std::int32_t value) {
+    for (int k = 0; k < 4; k++) {
+      code.push_back(std::uint8_t(value >> (8 * k)));
+    }
+  }
+
+  void emit_imm64(std::uint64_t value) {
+    for (int k = 0; k < 8; k++) {
+      code.push_back(std::uint8_t(value >> (8 * k)));
+    }
+  }
+
+  /// Emits an instruction whose memory operand is
+  /// the cell at the given offset, ie.
+  /// [rbx + r12 + offset]. reg is the ModRM reg
+  /// field.
+  void emit_cell_op(
+      std::initializer_list<std::uint8_t> opcode,
+      std::uint8_t reg, std::ptrdiff_t offset) {
+    code.push_back(0x42); // REX.X, for r12 as index
+    code.insert(code.end(), opcode);
+    code.push_back(0x84 | (reg << 3)); // disp32, SIB
+    code.push_back(0x23); // base rbx, index r12
+    emit_imm32(std::int32_t(offset));
+  }
+
+  /// add byte [cell], value
+  void add(int value, std::ptrdiff_t offset) {
+    emit_cell_op({0x80}, 0, offset);
+    code.push_back(std::uint8_t(value));
+  }
+
+  /// mov byte [cell], value
+  void set(int value, std::ptrdiff_t offset) {
+    emit_cell_op({0xc6}, 0, offset);
+    code.push_back(std::uint8_t(value));
+  }
+
+  /// add r12, offset
+  void move(std::ptrdiff_t offset) {
+    if (offset != 0) {
+      emit({0x49, 0x81, 0xc4});
+      emit_imm32(std::int32_t(offset));
+    }
+  }
+
+  /// cell[offset] += factor * cell[source], if
+  /// cell[source] is not zero
+  void mul_add(std::ptrdiff_t offset, int factor,
+               std::ptrdiff_t source) {
+    // movzx eax, byte [source]
+    emit_cell_op({0x0f, 0xb6}, 0, source);
+    emit({0x85, 0xc0}); // test eax, eax
+    std::size_t const skip = jump_if(equal_v);
+    // imul eax, eax, factor
+    emit({0x69, 0xc0});
+    emit_imm32(factor);
+    // add byte [cell], al
+    emit_cell_op({0x00}, 0, offset);
+    patch(skip, code.size());
+  }
+
+  /// Calls a function through rax
+  void call(void const *function) {
+    emit({0x48, 0xb8}); // mov rax, function
+    emit_imm64(std::uint64_t(function));
+    emit({0xff, 0xd0}); // call rax
+  }
+
+  /// Calls a function of the I/O table, with the
+  /// state as first argument
+  void call_io(std::int8_t function) {
+    // mov rdi, [r14 + io_state_v]
+    emit({0x49, 0x8b, 0x7e,
+          std::uint8_t(io_state_v)});
+    // call [r14 + function]
+    emit({0x41, 0xff, 0x56, std::uint8_t(function)});
+  }
+
+  void put(std::ptrdiff_t offset) {
+    // movsx esi, byte [cell]
+    emit_cell_op({0x0f, 0xbe}, 6, offset);
+    call_io(io_put_v);
+  }
+
+  void get(std::ptrdiff_t offset) {
+    call_io(io_get_v);
+    // mov byte [cell], al
+    emit_cell_op({0x88}, 0, offset);
+  }
+
+  /// Returns the position of the size operand
+  std::size_t print(char const *text,
+                    std::size_t size) {
+    emit({0x48, 0xbe}); // mov rsi, text
+    emit_imm64(std::uint64_t(text));
+    emit({0x48, 0xba}); // mov rdx, size
+    std::size_t const size_pos = code.size();
+    emit_imm64(size);
+    call_io(io_print_v);
+    return size_pos;
+  }
+
+  /// Moves the pointer, then scans
+  void scan(std::ptrdiff_t move,
+            std::ptrdiff_t stride) {
+    assembler_t::move(move);
+    emit({0x48, 0x89, 0xdf}); // mov rdi, rbx
+    emit({0x4c, 0x89, 0xe6}); // mov rsi, r12
+    emit({0x4c, 0x89, 0xea}); // mov rdx, r13
+    emit({0x48, 0xb9});       // mov rcx, stride
+    emit_imm64(std::uint64_t(stride));
+    call(reinterpret_cast<void const *>(&scan_tape));
+    emit({0x49, 0x89, 0xc4}); // mov r12, rax
+  }
+
+  /// cmp byte [cell], 0
+  void test_cell(std::ptrdiff_t offset) {
+    emit_cell_op({0x80}, 7, offset);
+    code.push_back(0);
+  }
+
+  /// Emits a conditional jump with the given
+  /// condition code, and returns the position of its
+  /// displacement so that it can be patched.
+  std::size_t jump_if(std::uint8_t condition) {
+    emit({0x0f, std::uint8_t(0x80 | condition)});
+    std::size_t const displacement = code.size();
+    emit_imm32(0);
+    return displacement;
+  }
+
+  /// Points a jump displacement to a target position
+  void patch(std::size_t displacement,
+             std::size_t target) {
+    std::int32_t const relative =
+        std::int32_t(target - (displacement + 4));
+    std::memcpy(code.data() + displacement, &relative,
+                4);
+  }
+
+  /// Emits a jump to be patched to the failure stub,
+  /// taken if pointer + offset is out of the tape.
+  /// Returns the position of its displacement.
+  std::size_t check_offset(std::ptrdiff_t offset) {
+    // lea rax, [r12 + offset]
+    emit({0x49, 0x8d, 0x84, 0x24});
+    emit_imm32(std::int32_t(offset));
+    emit({0x4c, 0x39, 0xe8}); // cmp rax, r13
+    return jump_if(above_or_equal_v);
+  }
+};
+
+/// Compilation state.
+struct compiler_t {
+  flat_blocks_t blocks;
+  assembler_t a = {};
+
+  /// Constant output buffer, large enough for all
+  /// the flat_print_t nodes of the program
+  char *text;
+  std::size_t text_size = 0;
+
+  /// End of the last print call, and position of its
+  /// size operand, so that consecutive prints can be
+  /// merged into a single call
+  std::size_t print_end = 0;
+  std::size_t print_size_pos = 0;
+
+  /// Bounds check jumps to the failure stub
+  std::vector<std::size_t> failures = {};
+
+  /// Emits the code of a block and of the blocks it
+  /// contains.
+  void emit_block(std::size_t block_id) {
+    for (flat_node_t const &node : blocks[block_id]) {
+      emit_node(node);
+    }
+  }
+
+  void emit_node(flat_node_t const &node) {
+    if (holds_alternative<flat_token_t>(node)) {
+      flat_token_t const &token =
+          get<flat_token_t>(node);
+      switch (token.token) {
+      case pointer_increase_v:
+        a.move(1);
+        break;
+      case pointer_decrease_v:
+        a.move(-1);
+        break;
+      case pointee_increase_v:
+        a.add(1, token.offset);
+        break;
+      case pointee_decrease_v:
+        a.add(-1, token.offset);
+        break;
+      case put_v:
+        a.put(token.offset);
+        break;
+      case get_v:
+        a.get(token.offset);
+        break;
+      default:
+        break;
+      }
+    }
+
+    // Loops are compiled to a forward branch over the
+    // body, and a backward branch to its beginning
+    else if (holds_alternative<flat_while_t>(node)) {
+      a.test_cell(0);
+      std::size_t const exit = a.jump_if(equal_v);
+      std::size_t const body = a.code.size();
+      emit_block(get<flat_while_t>(node).block_begin);
+      a.test_cell(0);
+      a.patch(a.jump_if(not_equal_v), body);
+      a.patch(exit, a.code.size());
+    }
+
+    else if (holds_alternative<flat_add_t>(node)) {
+      flat_add_t const &add = get<flat_add_t>(node);
+      a.add(add.value, add.offset);
+    }
+
+    else if (holds_alternative<flat_move_t>(node)) {
+      a.move(get<flat_move_t>(node).offset);
+    }
+
+    else if (holds_alternative<flat_set_t>(node)) {
+      flat_set_t const &set = get<flat_set_t>(node);
+      a.set(set.value, set.offset);
+    }
+
+    else if (holds_alternative<flat_mul_add_t>(
+                 node)) {
+      flat_mul_add_t const &mul_add =
+          get<flat_mul_add_t>(node);
+      a.mul_add(mul_add.offset, mul_add.factor,
+                mul_add.source);
+    }
+
+    else if (holds_alternative<flat_scan_t>(node)) {
+      a.scan(0, get<flat_scan_t>(node).stride);
+    }
+
+    else if (holds_alternative<flat_print_t>(node)) {
+      text[text_size] = get<flat_print_t>(node).value;
+      if (print_end == a.code.size() &&
+          print_end != 0) {
+        // Growing the previous call
+        std::uint64_t size;
+        std::uint8_t *const operand =
+            a.code.data() + print_size_pos;
+        std::memcpy(&size, operand, 8);
+        size++;
+        std::memcpy(operand, &size, 8);
+      } else {
+        print_size_pos = a.print(text + text_size, 1);
+      }
+      text_size++;
+      print_end = a.code.size();
+    }
+
+    else if (holds_alternative<flat_check_t>(node)) {
+      flat_check_t const &check =
+          get<flat_check_t>(node);
+      std::size_t skip = 0;
+      if (check.guarded) {
+        a.test_cell(check.guard);
+        skip = a.jump_if(equal_v);
+      }
+      failures.push_back(a.check_offset(check.min));
+      failures.push_back(a.check_offset(check.max));
+      if (check.guarded) {
+        a.patch(skip, a.code.size());
+      }
+    }
+
+    else if (holds_alternative<flat_add_move_t>(
+                 node)) {
+      flat_add_move_t const &add_move =
+          get<flat_add_move_t>(node);
+      a.add(add_move.value, add_move.offset);
+      a.move(add_move.move);
+    }
+
+    else if (holds_alternative<flat_move_set_t>(
+                 node)) {
+      flat_move_set_t const &move_set =
+          get<flat_move_set_t>(node);
+      a.move(move_set.move);
+      a.set(move_set.value, move_set.offset);
+    }
+
+    else if (holds_alternative<flat_mul_add_clear_t>(
+                 node)) {
+      flat_mul_add_clear_t const &mul_add =
+          get<flat_mul_add_clear_t>(node);
+      a.mul_add(mul_add.offset, mul_add.factor,
+                mul_add.source);
+      a.set(0, mul_add.source);
+    }
+
+    else if (holds_alternative<flat_move_scan_t>(
+                 node)) {
+      flat_move_scan_t const &move_scan =
+          get<flat_move_scan_t>(node);
+      a.scan(move_scan.move, move_scan.stride);
+    }
+  }
+};
+
+/// Unmaps the code of a program
+struct code_deleter_t {
+  std::size_t size;
+
+  void operator()(void *code) const {
+    munmap(code, size);
+  }
+};
+
+} // namespace jit_impl
+
+/// Compiled program.
+struct program_t {
+  /// Generated function, which takes the tape, the
+  /// pointer, the tape size and the I/O table, and
+  /// returns the pointer at the end of the program
+  using entry_t = std::size_t (*)(
+      char *, std::size_t, std::size_t,
+      jit_impl::io_t const *);
+
+  std::unique_ptr<void, jit_impl::code_deleter_t>
+      code;
+
+  /// Constant output, see flat_print_t
+  std::unique_ptr<char[]> text;
+
+  entry_t entry() const {
+    return reinterpret_cast<entry_t>(code.get());
+  }
+};
+
+/// Compiles a flat AST into machine code. Throws
+/// std::bad_alloc if the code cannot be mapped.
+inline program_t compile(flat_ast_t const &ast) {
+  using namespace jit_impl;
+
+  program_t program;
+  program.text = std::make_unique<char[]>(
+      std::ranges::count_if(
+          ast, [](flat_node_t const &node) {
+            return holds_alternative<flat_print_t>(
+                node);
+          }));
+
+  compiler_t c{split_blocks(ast), {},
+               program.text.get()};
+  assembler_t &a = c.a;
+
+  // Prologue: saving callee-saved registers, and
+  // keeping the stack aligned for calls
+  a.emit({0x55});                   // push rbp
+  a.emit({0x53});                   // push rbx
+  a.emit({0x41, 0x54});             // push r12
+  a.emit({0x41, 0x55});             // push r13
+  a.emit({0x41, 0x56});             // push r14
+  a.emit({0x48, 0x89, 0xfb});       // mov rbx, rdi
+  a.emit({0x49, 0x89, 0xf4});       // mov r12, rsi
+  a.emit({0x49, 0x89, 0xd5});       // mov r13, rdx
+  a.emit({0x49, 0x89, 0xce});       // mov r14, rcx
+
+  c.emit_block(0);
+
+  // Epilogue
+  a.emit({0x4c, 0x89, 0xe0});       // mov rax, r12
+  a.emit({0x41, 0x5e});             // pop r14
+  a.emit({0x41, 0x5d});             // pop r13
+  a.emit({0x41, 0x5c});             // pop r12
+  a.emit({0x5b});                   // pop rbx
+  a.emit({0x5d});                   // pop rbp
+  a.emit({0xc3});                   // ret
+
+  // Failure stub, shared by all the bounds checks
+  for (std::size_t failure : c.failures) {
+    a.patch(failure, a.code.size());
+  }
+  if (!c.failures.empty()) {
+    a.emit({0x4c, 0x89, 0xe6}); // mov rsi, r12
+    a.call_io(io_fail_v);
+  }
+
+  // W^X: the code is written to a writable mapping,
+  // which is then made executable and read-only
+  std::size_t const size = a.code.size();
+  void *const code =
+      mmap(nullptr, size, PROT_READ | PROT_WRITE,
+           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (code == MAP_FAILED) {
+    throw std::bad_alloc();
+  }
+  program.code = {code, code_deleter_t{size}};
+
+  std::memcpy(code, a.code.data(), size);
+  if (mprotect(code, size, PROT_READ | PROT_EXEC) !=
+      0) {
+    throw std::bad_alloc();
+  }
+
+  return program;
+}
+
+/// Runs a compiled program. The generated code
+/// accesses cells as bytes, and does I/O through the
+/// IO policy of the state.
+template <typename State>
+void run(program_t const &program, State &s) {
+  using namespace jit_impl;
+  static_assert(sizeof(s.data[0]) == 1,
+                "the JIT only supports byte cells");
+
+  io_t const io{&s, &put_cell<State>,
+                &get_cell<State>, &print_text<State>,
+                &fail_out_of_tape<State>};
+  s.i = program.entry()(
+      reinterpret_cast<char *>(s.data.data()), s.i,
+      s.data.size(), &io);
+}
+
+} // namespace brainfuck::flat::jit
+
+#endif
@@ -0,0 +1,239 @@
+#pragma once
+
+// Linear form of flat ASTs, where loops are turned
+// into conditional jumps. It is shared by the flat
+// backends that do not follow the block structure
+// of the AST.
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <brainfuck/backends/flat.hpp>
+
+namespace brainfuck::flat::linear {
+
+/// Kinds of linearized instructions
+enum instruction_kind_t : std::uint8_t {
+  /// Runs a flat node
+  node_v,
+  /// Jumps if the current cell is zero, ie. a loop
+  /// entry
+  jump_if_zero_v,
+  /// Jumps if the current cell is not zero, ie. a
+  /// loop back edge
+  jump_if_not_zero_v,
+  /// Runs a whole flat_while_t node, which is left
+  /// to the backend. Its block_begin is an index in
+  /// split_blocks instead of an AST position.
+  loop_v,
+};
+
+/// Linearized instruction.
+struct instruction_t {
+  instruction_kind_t kind = node_v;
+  flat_node_t node = flat_token_t{nop_v};
+
+  /// Jump target
+  size_t jump = 0;
+
+  /// Text slice written by a run of flat_print_t
+  /// nodes, see program_t::text
+  size_t text_begin = 0;
+  size_t text_size = 0;
+};
+
+/// Flat AST whose loops are turned into jumps.
+struct program_t {
+  std::vector<instruction_t> code;
+
+  /// Constant output of the flat_print_t nodes
+  std::string text;
+};
+
+/// Appends the instructions of a block and of the
+/// blocks it contains to a program. Loops whose body
+/// block is marked in kept_loops are not linearized.
+constexpr void
+linearize_block(flat_blocks_t const &blocks,
+                size_t block_id,
+                std::vector<bool> const &kept_loops,
+                program_t &program) {
+  std::vector<instruction_t> &code = program.code;
+
+  for (flat_node_t const &node : blocks[block_id]) {
+    if (holds_alternative<flat_while_t>(node) &&
+        kept_loops[get<flat_while_t>(node)
+                       .block_begin]) {
+      code.push_back({.kind = loop_v, .node = node});
+    }
+
+    else if (holds_alternative<flat_while_t>(node)) {
+      size_t const entry = code.size();
+      code.push_back({.kind = jump_if_zero_v});
+      linearize_block(
+          blocks, get<flat_while_t>(node).block_begin,
+          kept_loops, program);
+      code.push_back({.kind = jump_if_not_zero_v,
+                      .jump = entry + 1});
+      code[entry].jump = code.size();
+    }
+
+    // Runs of constant outputs are merged
+    else if (holds_alternative<flat_print_t>(node)) {
+      if (!code.empty() &&
+          holds_alternative<flat_print_t>(
+              code.back().node)) {
+        code.back().text_size++;
+      } else {
+        code.push_back({.node = node,
+                        .text_begin =
+                            program.text.size(),
+                        .text_size = 1});
+      }
+      program.text.push_back(
+          get<flat_print_t>(node).value);
+    }
+
+    else {
+      code.push_back({.node = node});
+    }
+  }
+}
+
+/// Linearizes a flat AST. kept_loops is indexed by
+/// the blocks of split_blocks, see linearize_block.
+constexpr program_t
+linearize(flat_ast_t const &ast,
+          std::vector<bool> kept_loops = {}) {
+  flat_blocks_t const blocks = split_blocks(ast);
+  kept_loops.resize(blocks.size());
+
+  program_t program;
+  linearize_block(blocks, 0, kept_loops, program);
+  return program;
+}
+
+/// NTTP-compatible program_t.
+template <size_t CodeSize, size_t TextSize>
+struct fixed_program_t {
+  std::array<instruction_t, CodeSize> code;
+  std::array<char, TextSize> text;
+};
+
+/// Linearized version of a fixed_flat_ast_t.
+template <auto const &Ast>
+inline constexpr auto linearized = [] {
+  auto const program = [] {
+    return linearize(
+        flat_ast_t(Ast.begin(), Ast.end()));
+  };
+  constexpr size_t CodeSize = program().code.size();
+  constexpr size_t TextSize = program().text.size();
+
+  fixed_program_t<CodeSize, TextSize> fixed;
+  program_t const result = program();
+  std::ranges::copy(result.code, fixed.code.begin());
+  std::ranges::copy(result.text, fixed.text.begin());
+  return fixed;
+}();
+
+/// Runs a node other than flat_while_t and
+/// flat_print_t. Instantiated once per distinct node
+/// value.
+template <typename State, auto Node>
+void run_node(State &s) {
+  // Class type NTTPs are const
+  using node_t = std::remove_const_t<decltype(Node)>;
+
+  if constexpr (std::is_same_v<node_t,
+                               flat_token_t>) {
+    if constexpr (Node.token == pointer_increase_v) {
+      ++s.i;
+    } else if constexpr (Node.token ==
+                         pointer_decrease_v) {
+      --s.i;
+    } else if constexpr (Node.token ==
+                         pointee_increase_v) {
+      s.data[s.i + Node.offset]++;
+    } else if constexpr (Node.token ==
+                         pointee_decrease_v) {
+      s.data[s.i + Node.offset]--;
+    } else if constexpr (Node.token == put_v) {
+      output_char(s, s.data[s.i + Node.offset]);
+    } else if constexpr (Node.token == get_v) {
+      s.data[s.i + Node.offset] = input_char(s);
+    }
+  }
+
+  else if constexpr (std::is_same_v<node_t,
+                                    flat_add_t>) {
+    s.data[s.i + Node.offset] += Node.value;
+  }
+
+  else if constexpr (std::is_same_v<node_t,
+                                    flat_move_t>) {
+    s.i += Node.offset;
+  }
+
+  else if constexpr (std::is_same_v<node_t,
+                                    flat_set_t>) {
+    s.data[s.i + Node.offset] = Node.value;
+  }
+
+  else if constexpr (std::is_same_v<node_t,
+                                    flat_mul_add_t>) {
+    if (s.data[s.i + Node.source] != 0) {
+      s.data[s.i + Node.offset] +=
+          Node.factor * s.data[s.i + Node.source];
+    }
+  }
+
+  else if constexpr (std::is_same_v<node_t,
+                                    flat_scan_t>) {
+    s.i = scan<Node.stride>(s.data, s.i);
+  }
+
+  else if constexpr (std::is_same_v<node_t,
+                                    flat_check_t>) {
+    if ((!Node.guarded ||
+         s.data[s.i + Node.guard] != 0) &&
+        (s.i + Node.min >= s.data.size() ||
+         s.i + Node.max >= s.data.size()))
+        [[unlikely]] {
+      out_of_tape(s, s.i);
+    }
+  }
+
+  else if constexpr (std::is_same_v<
+                         node_t, flat_add_move_t>) {
+    s.data[s.i + Node.offset] += Node.value;
+    s.i += Node.move;
+  }
+
+  else if constexpr (std::is_same_v<
+                         node_t, flat_move_set_t>) {
+    s.i += Node.move;
+    s.data[s.i + Node.offset] = Node.value;
+  }
+
+  else if constexpr (
+      std::is_same_v<node_t, flat_mul_add_clear_t>) {
+    if (s.data[s.i + Node.source] != 0) {
+      s.data[s.i + Node.offset] +=
+          Node.factor * s.data[s.i + Node.source];
+      s.data[s.i + Node.source] = 0;
+    }
+  }
+
+  else if constexpr (std::is_same_v<
+                         node_t, flat_move_scan_t>) {
+    s.i = scan<Node.stride>(s.data, s.i + Node.move);
+  }
+}
+
+} // namespace brainfuck::flat::linear
@@ -13,28 +13,31 @@ constexpr auto codegen() {
                     Instr)) {
     constexpr flat_token_t Token =
         get<flat_token_t>(Instr);
+    constexpr std::ptrdiff_t Offset = Token.offset;
 
     if constexpr (Token.token == pointer_increase_v) {
-      return [](program_state_t &s) { ++s.i; };
+      return [](auto &s) { ++s.i; };
     } else if constexpr (Token.token ==
                          pointer_decrease_v) {
-      return [](program_state_t &s) { --s.i; };
+      return [](auto &s) { --s.i; };
     } else if constexpr (Token.token ==
                          pointee_increase_v) {
-      return
-          [](program_state_t &s) { s.data[s.i]++; };
+      return [](auto &s) {
+        s.data[s.i + Offset]++;
+      };
 
     } else if constexpr (Token.token ==
                          pointee_decrease_v) {
-      return
-          [](program_state_t &s) { s.data[s.i]--; };
+      return [](auto &s) {
+        s.data[s.i + Offset]--;
+      };
     } else if constexpr (Token.token == put_v) {
-      return [](program_state_t &s) {
-        std::putchar(s.data[s.i]);
+      return [](auto &s) {
+        output_char(s, s.data[s.i + Offset]);
       };
     } else if constexpr (Token.token == get_v) {
-      return [](program_state_t &s) {
-        s.data[s.i] = std::getchar();
+      return [](auto &s) {
+        s.data[s.i + Offset] = input_char(s);
       };
     }
   }
@@ -47,7 +50,11 @@ constexpr auto codegen() {
     constexpr flat_block_descriptor_t
         BlockDescriptor =
             get<flat_block_descriptor_t>(Instr);
-    return [](program_state_t &s) {
+    return [](auto &s) {
+      static_assert(sizeof(s.data[0]) ==
+                        Ast.cell_size,
+                    "state and AST cell sizes "
+                    "differ");
       [&]<size_t... InstructionIDs>(
           std::index_sequence<InstructionIDs...>) {
         (codegen<Ast, 1 + InstructionPos +
@@ -64,11 +71,173 @@ constexpr auto codegen() {
                          Instr)) {
     constexpr flat_while_t While =
         get<flat_while_t>(Instr);
-    return [](program_state_t &s) {
+    return [](auto &s) {
       while (s.data[s.i]) {
         codegen<Ast, While.block_begin>()(s);
       }
     };
   }
+
+  /// Folded cell increment
+  else if constexpr (holds_alternative<flat_add_t>(
+                         Instr)) {
+    constexpr int Value =
+        get<flat_add_t>(Instr).value;
+    constexpr std::ptrdiff_t Offset =
+        get<flat_add_t>(Instr).offset;
+    return [](auto &s) {
+      s.data[s.i + Offset] += Value;
+    };
+  }
+
+  /// Folded pointer move
+  else if constexpr (holds_alternative<flat_move_t>(
+                         Instr)) {
+    constexpr flat_move_t Move =
+        get<flat_move_t>(Instr);
+    return
+        [](auto &s) { s.i += Move.offset; };
+  }
+
+  /// Cell store, ie. a lowered clear loop
+  else if constexpr (holds_alternative<flat_set_t>(
+                         Instr)) {
+    constexpr int Value =
+        get<flat_set_t>(Instr).value;
+    constexpr std::ptrdiff_t Offset =
+        get<flat_set_t>(Instr).offset;
+    return [](auto &s) {
+      s.data[s.i + Offset] = Value;
+    };
+  }
+
+  /// Multiply loop update
+  else if constexpr (
+      holds_alternative<flat_mul_add_t>(Instr)) {
+    constexpr std::ptrdiff_t Offset =
+        get<flat_mul_add_t>(Instr).offset;
+    constexpr int Factor =
+        get<flat_mul_add_t>(Instr).factor;
+    constexpr std::ptrdiff_t Source =
+        get<flat_mul_add_t>(Instr).source;
+    return [](auto &s) {
+      if (s.data[s.i + Source] != 0) {
+        s.data[s.i + Offset] +=
+            Factor * s.data[s.i + Source];
+      }
+    };
+  }
+
+  /// Scan loop
+  else if constexpr (holds_alternative<flat_scan_t>(
+                         Instr)) {
+    constexpr std::ptrdiff_t Stride =
+        get<flat_scan_t>(Instr).stride;
+    return [](auto &s) {
+      s.i = scan<Stride>(s.data, s.i);
+    };
+  }
+
+  /// Constant output, written once per run of
+  /// consecutive flat_print_t nodes
+  else if constexpr (holds_alternative<flat_print_t>(
+                         Instr)) {
+    if constexpr (
+        continues_print_run<Ast, InstructionPos>()) {
+      return [](auto &) {};
+    } else {
+      return [](auto &s) {
+        constexpr auto const &Run =
+            print_run<Ast, InstructionPos>;
+        output_text(s, Run.data(), Run.size());
+      };
+    }
+  }
+
+  /// Tape bounds check
+  else if constexpr (holds_alternative<flat_check_t>(
+                         Instr)) {
+    constexpr std::ptrdiff_t Min =
+        get<flat_check_t>(Instr).min;
+    constexpr std::ptrdiff_t Max =
+        get<flat_check_t>(Instr).max;
+    constexpr bool Guarded =
+        get<flat_check_t>(Instr).guarded;
+    constexpr std::ptrdiff_t Guard =
+        get<flat_check_t>(Instr).guard;
+    return [](auto &s) {
+      if constexpr (Guarded) {
+        if (s.data[s.i + Guard] == 0) {
+          return;
+        }
+      }
+      if (s.i + Min >= s.data.size() ||
+          s.i + Max >= s.data.size()) [[unlikely]] {
+        out_of_tape(s, s.i);
+      }
+    };
+  }
+
+  /// Superinstruction: cell increment then move
+  else if constexpr (
+      holds_alternative<flat_add_move_t>(Instr)) {
+    constexpr int Value =
+        get<flat_add_move_t>(Instr).value;
+    constexpr std::ptrdiff_t Offset =
+        get<flat_add_move_t>(Instr).offset;
+    constexpr std::ptrdiff_t Move =
+        get<flat_add_move_t>(Instr).move;
+    return [](auto &s) {
+      s.data[s.i + Offset] += Value;
+      s.i += Move;
+    };
+  }
+
+  /// Superinstruction: move then cell store
+  else if constexpr (
+      holds_alternative<flat_move_set_t>(Instr)) {
+    constexpr std::ptrdiff_t Move =
+        get<flat_move_set_t>(Instr).move;
+    constexpr int Value =
+        get<flat_move_set_t>(Instr).value;
+    constexpr std::ptrdiff_t Offset =
+        get<flat_move_set_t>(Instr).offset;
+    return [](auto &s) {
+      s.i += Move;
+      s.data[s.i + Offset] = Value;
+    };
+  }
+
+  /// Superinstruction: multiply loop update then
+  /// source clear
+  else if constexpr (
+      holds_alternative<flat_mul_add_clear_t>(
+          Instr)) {
+    constexpr std::ptrdiff_t Offset =
+        get<flat_mul_add_clear_t>(Instr).offset;
+    constexpr int Factor =
+        get<flat_mul_add_clear_t>(Instr).factor;
+    constexpr std::ptrdiff_t Source =
+        get<flat_mul_add_clear_t>(Instr).source;
+    return [](auto &s) {
+      if (s.data[s.i + Source] != 0) {
+        s.data[s.i + Offset] +=
+            Factor * s.data[s.i + Source];
+        s.data[s.i + Source] = 0;
+      }
+    };
+  }
+
+  /// Superinstruction: move then scan loop
+  else if constexpr (holds_alternative<
+                         flat_move_scan_t>(Instr)) {
+    constexpr std::ptrdiff_t Move =
+        get<flat_move_scan_t>(Instr).move;
+    constexpr std::ptrdiff_t Stride =
+        get<flat_move_scan_t>(Instr).stride;
+    return [](auto &s) {
+      s.i = scan<Stride>(s.data, s.i + Move);
+    };
+  }
 }
 } // namespace brainfuck::flat::monolithic
@@ -6,7 +6,7 @@ namespace brainfuck::flat::monolithic {
 /// Runs a program contained in a fixed_flat_ast_t
 /// container
 template <auto const &Ast, size_t InstructionPos = 0>
-void run(program_state_t &s) {
+void run(auto &s) {
   constexpr flat_node_t const &Instr =
       Ast[InstructionPos];
 
@@ -23,14 +23,14 @@ void run(program_state_t &s) {
       --s.i;
     } else if constexpr (Token.token ==
                          pointee_increase_v) {
-      s.data[s.i]++;
+      s.data[s.i + Token.offset]++;
     } else if constexpr (Token.token ==
                          pointee_decrease_v) {
-      s.data[s.i]--;
+      s.data[s.i + Token.offset]--;
     } else if constexpr (Token.token == put_v) {
-      std::putchar(s.data[s.i]);
+      output_char(s, s.data[s.i + Token.offset]);
     } else if constexpr (Token.token == get_v) {
-      s.data[s.i] = std::getchar();
+      s.data[s.i + Token.offset] = input_char(s);
     }
   }
 
@@ -41,6 +41,8 @@ void run(program_state_t &s) {
     constexpr flat_block_descriptor_t const
         &BlockDescriptor =
             get<flat_block_descriptor_t>(Instr);
+    static_assert(sizeof(s.data[0]) == Ast.cell_size,
+                  "state and AST cell sizes differ");
 
     [&]<size_t... InstructionIDs>(
         std::index_sequence<InstructionIDs...>) {
@@ -60,6 +62,113 @@ void run(program_state_t &s) {
       run<Ast, While.block_begin>(s);
     }
   }
+
+  /// Folded cell increment
+  else if constexpr (std::holds_alternative<
+                         flat_add_t>(Instr)) {
+    constexpr flat_add_t const &Add =
+        get<flat_add_t>(Instr);
+    s.data[s.i + Add.offset] += Add.value;
+  }
+
+  /// Folded pointer move
+  else if constexpr (std::holds_alternative<
+                         flat_move_t>(Instr)) {
+    s.i += get<flat_move_t>(Instr).offset;
+  }
+
+  /// Cell store, ie. a lowered clear loop
+  else if constexpr (std::holds_alternative<
+                         flat_set_t>(Instr)) {
+    constexpr flat_set_t const &Set =
+        get<flat_set_t>(Instr);
+    s.data[s.i + Set.offset] = Set.value;
+  }
+
+  /// Multiply loop update
+  else if constexpr (std::holds_alternative<
+                         flat_mul_add_t>(Instr)) {
+    constexpr flat_mul_add_t const &MulAdd =
+        get<flat_mul_add_t>(Instr);
+    if (s.data[s.i + MulAdd.source] != 0) {
+      s.data[s.i + MulAdd.offset] +=
+          MulAdd.factor * s.data[s.i + MulAdd.source];
+    }
+  }
+
+  /// Scan loop
+  else if constexpr (std::holds_alternative<
+                         flat_scan_t>(Instr)) {
+    s.i = scan<get<flat_scan_t>(Instr).stride>(s.data,
+                                                 s.i);
+  }
+
+  /// Constant output, written once per run of
+  /// consecutive flat_print_t nodes
+  else if constexpr (std::holds_alternative<
+                         flat_print_t>(Instr)) {
+    if constexpr (!continues_print_run<
+                      Ast, InstructionPos>()) {
+      constexpr auto const &Run =
+          print_run<Ast, InstructionPos>;
+      output_text(s, Run.data(), Run.size());
+    }
+  }
+
+  /// Tape bounds check
+  else if constexpr (std::holds_alternative<
+                         flat_check_t>(Instr)) {
+    constexpr flat_check_t const &Check =
+        get<flat_check_t>(Instr);
+    if ((!Check.guarded ||
+         s.data[s.i + Check.guard] != 0) &&
+        (s.i + Check.min >= s.data.size() ||
+         s.i + Check.max >= s.data.size()))
+        [[unlikely]] {
+      out_of_tape(s, s.i);
+    }
+  }
+
+  /// Superinstruction: cell increment then move
+  else if constexpr (std::holds_alternative<
+                         flat_add_move_t>(Instr)) {
+    constexpr flat_add_move_t const &AddMove =
+        get<flat_add_move_t>(Instr);
+    s.data[s.i + AddMove.offset] += AddMove.value;
+    s.i += AddMove.move;
+  }
+
+  /// Superinstruction: move then cell store
+  else if constexpr (std::holds_alternative<
+                         flat_move_set_t>(Instr)) {
+    constexpr flat_move_set_t const &MoveSet =
+        get<flat_move_set_t>(Instr);
+    s.i += MoveSet.move;
+    s.data[s.i + MoveSet.offset] = MoveSet.value;
+  }
+
+  /// Superinstruction: multiply loop update then
+  /// source clear
+  else if constexpr (
+      std::holds_alternative<flat_mul_add_clear_t>(
+          Instr)) {
+    constexpr flat_mul_add_clear_t const &MulAdd =
+        get<flat_mul_add_clear_t>(Instr);
+    if (s.data[s.i + MulAdd.source] != 0) {
+      s.data[s.i + MulAdd.offset] +=
+          MulAdd.factor * s.data[s.i + MulAdd.source];
+      s.data[s.i + MulAdd.source] = 0;
+    }
+  }
+
+  /// Superinstruction: move then scan loop
+  else if constexpr (std::holds_alternative<
+                         flat_move_scan_t>(Instr)) {
+    constexpr flat_move_scan_t const &MoveScan =
+        get<flat_move_scan_t>(Instr);
+    s.i = scan<MoveScan.stride>(s.data,
+                                s.i + MoveScan.move);
+  }
 }
 
 } // namespace brainfuck::flat::monolithic
@@ -17,6 +17,7 @@ constexpr auto codegen(flat_token_t) {
   // Extracting token value
   constexpr flat_token_t Token =
       get<flat_token_t>(Ast[InstructionPos]);
+  constexpr std::ptrdiff_t Offset = Token.offset;
 
   // Returning code for a single Brainfuck
   // instruction
@@ -24,36 +25,38 @@ constexpr auto codegen(flat_token_t) {
   // >
   if constexpr (Token.token ==
                 pointer_increase_v) {
-    return [](program_state_t &s) { ++s.i; };
+    return [](auto &s) { ++s.i; };
   }
   // <
   else if constexpr (Token.token ==
                      pointer_decrease_v) {
-    return [](program_state_t &s) { --s.i; };
+    return [](auto &s) { --s.i; };
   }
   // +
   else if constexpr (Token.token ==
                      pointee_increase_v) {
-    return
-        [](program_state_t &s) { s.data[s.i]++; };
+    return [](auto &s) {
+      s.data[s.i + Offset]++;
+    };
 
   }
   // -
   else if constexpr (Token.token ==
                      pointee_decrease_v) {
-    return
-        [](program_state_t &s) { s.data[s.i]--; };
+    return [](auto &s) {
+      s.data[s.i + Offset]--;
+    };
   }
   // .
   else if constexpr (Token.token == put_v) {
-    return [](program_state_t &s) {
-      std::putchar(s.data[s.i]);
+    return [](auto &s) {
+      output_char(s, s.data[s.i + Offset]);
     };
   }
   // ,
   else if constexpr (Token.token == get_v) {
-    return [](program_state_t &s) {
-      s.data[s.i] = std::getchar();
+    return [](auto &s) {
+      s.data[s.i + Offset] = input_char(s);
     };
   }
 }
@@ -63,7 +66,10 @@ constexpr auto codegen(flat_token_t) {
 template <auto const &Ast,
           size_t InstructionPos = 0>
 constexpr auto codegen(flat_block_descriptor_t) {
-  return [](program_state_t &s) {
+  return [](auto &s) {
+    static_assert(sizeof(s.data[0]) == Ast.cell_size,
+                  "state and AST cell sizes differ");
+
     // Generating an index sequence type
     // with a size equal to the code block size.
     // It will be passed to the template lambda
@@ -99,13 +105,212 @@ constexpr auto codegen(flat_while_t) {
                        .block_begin>();
 
   // Whole while expression
-  return [body](program_state_t &s) {
+  return [body](auto &s) {
     while (s.data[s.i]) {
       body(s);
     }
   };
 }
 
+/// Code generation implementation
+/// for a folded cell increment
+template <auto const &Ast,
+          size_t InstructionPos = 0>
+constexpr auto codegen(flat_add_t) {
+  constexpr int Value =
+      get<flat_add_t>(Ast[InstructionPos]).value;
+  constexpr std::ptrdiff_t Offset =
+      get<flat_add_t>(Ast[InstructionPos]).offset;
+
+  return [](auto &s) {
+    s.data[s.i + Offset] += Value;
+  };
+}
+
+/// Code generation implementation
+/// for a folded pointer move
+template <auto const &Ast,
+          size_t InstructionPos = 0>
+constexpr auto codegen(flat_move_t) {
+  constexpr flat_move_t Move =
+      get<flat_move_t>(Ast[InstructionPos]);
+
+  return
+      [](auto &s) { s.i += Move.offset; };
+}
+
+/// Code generation implementation
+/// for a cell store
+template <auto const &Ast,
+          size_t InstructionPos = 0>
+constexpr auto codegen(flat_set_t) {
+  constexpr int Value =
+      get<flat_set_t>(Ast[InstructionPos]).value;
+  constexpr std::ptrdiff_t Offset =
+      get<flat_set_t>(Ast[InstructionPos]).offset;
+
+  return [](auto &s) {
+    s.data[s.i + Offset] = Value;
+  };
+}
+
+/// Code generation implementation
+/// for a multiply loop update
+template <auto const &Ast,
+          size_t InstructionPos = 0>
+constexpr auto codegen(flat_mul_add_t) {
+  constexpr std::ptrdiff_t Offset =
+      get<flat_mul_add_t>(Ast[InstructionPos]).offset;
+  constexpr int Factor =
+      get<flat_mul_add_t>(Ast[InstructionPos]).factor;
+  constexpr std::ptrdiff_t Source =
+      get<flat_mul_add_t>(Ast[InstructionPos]).source;
+
+  return [](auto &s) {
+    if (s.data[s.i + Source] != 0) {
+      s.data[s.i + Offset] +=
+          Factor * s.data[s.i + Source];
+    }
+  };
+}
+
+/// Code generation implementation
+/// for a scan loop
+template <auto const &Ast,
+          size_t InstructionPos = 0>
+constexpr auto codegen(flat_scan_t) {
+  constexpr std::ptrdiff_t Stride =
+      get<flat_scan_t>(Ast[InstructionPos]).stride;
+
+  return [](auto &s) {
+    s.i = scan<Stride>(s.data, s.i);
+  };
+}
+
+/// Code generation implementation
+/// for a constant output
+template <auto const &Ast,
+          size_t InstructionPos = 0>
+constexpr auto codegen(flat_print_t) {
+  // Runs of consecutive flat_print_t nodes are
+  // written by their first node
+  if constexpr (
+      continues_print_run<Ast, InstructionPos>()) {
+    return [](auto &) {};
+  } else {
+    return [](auto &s) {
+      constexpr auto const &Run =
+          print_run<Ast, InstructionPos>;
+      output_text(s, Run.data(), Run.size());
+    };
+  }
+}
+
+/// Code generation implementation
+/// for a tape bounds check
+template <auto const &Ast,
+          size_t InstructionPos = 0>
+constexpr auto codegen(flat_check_t) {
+  constexpr std::ptrdiff_t Min =
+      get<flat_check_t>(Ast[InstructionPos]).min;
+  constexpr std::ptrdiff_t Max =
+      get<flat_check_t>(Ast[InstructionPos]).max;
+  constexpr bool Guarded =
+      get<flat_check_t>(Ast[InstructionPos]).guarded;
+  constexpr std::ptrdiff_t Guard =
+      get<flat_check_t>(Ast[InstructionPos]).guard;
+
+  return [](auto &s) {
+    if constexpr (Guarded) {
+      if (s.data[s.i + Guard] == 0) {
+        return;
+      }
+    }
+    if (s.i + Min >= s.data.size() ||
+        s.i + Max >= s.data.size()) [[unlikely]] {
+      out_of_tape(s, s.i);
+    }
+  };
+}
+
+/// Code generation implementation
+/// for an increment and move superinstruction
+template <auto const &Ast,
+          size_t InstructionPos = 0>
+constexpr auto codegen(flat_add_move_t) {
+  constexpr int Value =
+      get<flat_add_move_t>(Ast[InstructionPos]).value;
+  constexpr std::ptrdiff_t Offset =
+      get<flat_add_move_t>(Ast[InstructionPos])
+          .offset;
+  constexpr std::ptrdiff_t Move =
+      get<flat_add_move_t>(Ast[InstructionPos]).move;
+
+  return [](auto &s) {
+    s.data[s.i + Offset] += Value;
+    s.i += Move;
+  };
+}
+
+/// Code generation implementation
+/// for a move and store superinstruction
+template <auto const &Ast,
+          size_t InstructionPos = 0>
+constexpr auto codegen(flat_move_set_t) {
+  constexpr std::ptrdiff_t Move =
+      get<flat_move_set_t>(Ast[InstructionPos]).move;
+  constexpr int Value =
+      get<flat_move_set_t>(Ast[InstructionPos]).value;
+  constexpr std::ptrdiff_t Offset =
+      get<flat_move_set_t>(Ast[InstructionPos])
+          .offset;
+
+  return [](auto &s) {
+    s.i += Move;
+    s.data[s.i + Offset] = Value;
+  };
+}
+
+/// Code generation implementation
+/// for a multiply and clear superinstruction
+template <auto const &Ast,
+          size_t InstructionPos = 0>
+constexpr auto codegen(flat_mul_add_clear_t) {
+  constexpr std::ptrdiff_t Offset =
+      get<flat_mul_add_clear_t>(Ast[InstructionPos])
+          .offset;
+  constexpr int Factor =
+      get<flat_mul_add_clear_t>(Ast[InstructionPos])
+          .factor;
+  constexpr std::ptrdiff_t Source =
+      get<flat_mul_add_clear_t>(Ast[InstructionPos])
+          .source;
+
+  return [](auto &s) {
+    if (s.data[s.i + Source] != 0) {
+      s.data[s.i + Offset] +=
+          Factor * s.data[s.i + Source];
+      s.data[s.i + Source] = 0;
+    }
+  };
+}
+
+/// Code generation implementation
+/// for a move and scan superinstruction
+template <auto const &Ast,
+          size_t InstructionPos = 0>
+constexpr auto codegen(flat_move_scan_t) {
+  constexpr std::ptrdiff_t Move =
+      get<flat_move_scan_t>(Ast[InstructionPos]).move;
+  constexpr std::ptrdiff_t Stride =
+      get<flat_move_scan_t>(Ast[InstructionPos])
+          .stride;
+
+  return [](auto &s) {
+    s.i = scan<Stride>(s.data, s.i + Move);
+  };
+}
+
 /// Generic code generation entrypoint
 template <auto const &Ast, size_t InstructionPos>
 constexpr auto codegen() {
@@ -0,0 +1,418 @@
+#pragma once
+
+// Compile-time partial evaluation of flat ASTs:
+// programs are interpreted in constexpr functions
+// until they need input or run out of steps. The
+// output and the tape state at that point are then
+// captured along with the rest of the program, which
+// is left to the backends.
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <brainfuck/backends/flat.hpp>
+#include <brainfuck/program.hpp>
+
+namespace brainfuck::flat {
+
+/// Default number of steps for partial evaluation.
+inline constexpr size_t default_step_budget = 1 << 20;
+
+/// Result of a partial evaluation.
+struct partial_evaluation_t {
+  /// Output of the evaluated prefix
+  std::string output;
+
+  /// Tape state after the evaluated prefix. Cells
+  /// that are out of this vector are zero.
+  std::vector<char> tape;
+
+  /// Pointer position after the evaluated prefix
+  size_t pointer = 0;
+
+  /// Instructions that remain to be run. The root
+  /// block is empty if the whole program was
+  /// evaluated.
+  flat_ast_t residual;
+};
+
+namespace partial_evaluation_impl {
+
+/// Tape length of program_state_t
+inline constexpr std::ptrdiff_t tape_length =
+    std::tuple_size_v<
+        decltype(program_state_t::data)>;
+
+/// Interpreter state
+struct machine_t {
+  std::vector<char> tape;
+  std::ptrdiff_t pointer = 0;
+  std::string output;
+  size_t steps_left;
+
+  /// Returns a pointer to the cell at the given
+  /// offset, or nullptr if it is out of the tape.
+  constexpr char *cell(std::ptrdiff_t offset) {
+    std::ptrdiff_t const pos = pointer + offset;
+    if (pos < 0 || pos >= tape_length) {
+      return nullptr;
+    }
+    if (size_t(pos) >= tape.size()) {
+      tape.resize(pos + 1, 0);
+    }
+    return &tape[pos];
+  }
+};
+
+constexpr bool exec_block(flat_blocks_t const &blocks,
+                          size_t block_id,
+                          machine_t &m);
+
+/// Executes a scan loop, see exec.
+constexpr bool exec_scan(std::ptrdiff_t stride,
+                         machine_t &m) {
+  for (char *c = m.cell(0); c == nullptr || *c != 0;
+       c = m.cell(0)) {
+    if (c == nullptr || m.steps_left == 0) {
+      return false;
+    }
+    m.steps_left--;
+    m.pointer += stride;
+  }
+  return true;
+}
+
+/// Executes a single node. Returns false if the
+/// evaluation must stop before the node, ie. when
+/// it reads input, accesses a cell out of the tape,
+/// or when the step budget is exhausted. Nodes other
+/// than loops and scans have no side effect in this
+/// case.
+constexpr bool exec(flat_blocks_t const &blocks,
+                    flat_node_t const &node,
+                    machine_t &m) {
+  if (m.steps_left == 0) {
+    return false;
+  }
+  m.steps_left--;
+
+  if (holds_alternative<flat_token_t>(node)) {
+    flat_token_t const &token =
+        get<flat_token_t>(node);
+    switch (token.token) {
+    case pointer_increase_v:
+      m.pointer++;
+      return true;
+    case pointer_decrease_v:
+      m.pointer--;
+      return true;
+    case get_v:
+      return false;
+    default:
+      break;
+    }
+
+    char *c = m.cell(token.offset);
+    if (c == nullptr) {
+      return false;
+    }
+    if (token.token == pointee_increase_v) {
+      ++*c;
+    } else if (token.token == pointee_decrease_v) {
+      --*c;
+    } else if (token.token == put_v) {
+      m.output.push_back(*c);
+    }
+  }
+
+  else if (holds_alternative<flat_add_t>(node)) {
+    flat_add_t const &add = get<flat_add_t>(node);
+    char *c = m.cell(add.offset);
+    if (c == nullptr) {
+      return false;
+    }
+    *c += add.value;
+  }
+
+  else if (holds_alternative<flat_set_t>(node)) {
+    flat_set_t const &set = get<flat_set_t>(node);
+    char *c = m.cell(set.offset);
+    if (c == nullptr) {
+      return false;
+    }
+    *c = set.value;
+  }
+
+  else if (holds_alternative<flat_mul_add_t>(node)) {
+    flat_mul_add_t const &mul_add =
+        get<flat_mul_add_t>(node);
+    char *src = m.cell(mul_add.source);
+    if (src == nullptr) {
+      return false;
+    }
+    // The target is only accessed if the loop runs
+    if (*src != 0) {
+      char *dst = m.cell(mul_add.offset);
+      if (dst == nullptr) {
+        return false;
+      }
+      // Resizing may have moved src
+      src = m.cell(mul_add.source);
+      *dst += mul_add.factor * *src;
+    }
+  }
+
+  else if (holds_alternative<flat_move_t>(node)) {
+    m.pointer += get<flat_move_t>(node).offset;
+  }
+
+  else if (holds_alternative<flat_print_t>(node)) {
+    m.output.push_back(get<flat_print_t>(node).value);
+  }
+
+  else if (holds_alternative<flat_scan_t>(node)) {
+    return exec_scan(get<flat_scan_t>(node).stride,
+                     m);
+  }
+
+  else if (holds_alternative<flat_while_t>(node)) {
+    for (char *c = m.cell(0); c == nullptr || *c != 0;
+         c = m.cell(0)) {
+      if (c == nullptr || m.steps_left == 0) {
+        return false;
+      }
+      m.steps_left--;
+      size_t const body =
+          get<flat_while_t>(node).block_begin;
+      if (!exec_block(blocks, body, m)) {
+        return false;
+      }
+    }
+  }
+
+  else if (holds_alternative<flat_check_t>(node)) {
+    flat_check_t const &check =
+        get<flat_check_t>(node);
+    if (check.guarded &&
+        m.cell(check.guard) == nullptr) {
+      return false;
+    }
+    if (check.guarded && *m.cell(check.guard) == 0) {
+      return true;
+    }
+    if (m.pointer + check.min < 0 ||
+        m.pointer + check.max >= tape_length) {
+      return false;
+    }
+  }
+
+  else if (holds_alternative<flat_add_move_t>(node)) {
+    flat_add_move_t const &add_move =
+        get<flat_add_move_t>(node);
+    char *c = m.cell(add_move.offset);
+    if (c == nullptr) {
+      return false;
+    }
+    *c += add_move.value;
+    m.pointer += add_move.move;
+  }
+
+  else if (holds_alternative<flat_move_set_t>(node)) {
+    flat_move_set_t const &move_set =
+        get<flat_move_set_t>(node);
+    char *c = m.cell(move_set.move + move_set.offset);
+    if (c == nullptr) {
+      return false;
+    }
+    *c = move_set.value;
+    m.pointer += move_set.move;
+  }
+
+  else if (holds_alternative<flat_mul_add_clear_t>(
+               node)) {
+    flat_mul_add_clear_t const &mul_add =
+        get<flat_mul_add_clear_t>(node);
+    char *src = m.cell(mul_add.source);
+    if (src == nullptr) {
+      return false;
+    }
+    // The target is only accessed if the loop runs
+    if (*src != 0) {
+      char *dst = m.cell(mul_add.offset);
+      if (dst == nullptr) {
+        return false;
+      }
+      // Resizing may have moved src
+      src = m.cell(mul_add.source);
+      *dst += mul_add.factor * *src;
+      *src = 0;
+    }
+  }
+
+  else if (holds_alternative<flat_move_scan_t>(
+               node)) {
+    flat_move_scan_t const &move_scan =
+        get<flat_move_scan_t>(node);
+    m.pointer += move_scan.move;
+    return exec_scan(move_scan.stride, m);
+  }
+
+  return true;
+}
+
+/// Executes a block, see exec.
+constexpr bool exec_block(flat_blocks_t const &blocks,
+                          size_t block_id,
+                          machine_t &m) {
+  for (flat_node_t const &node : blocks[block_id]) {
+    if (!exec(blocks, node, m)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+} // namespace partial_evaluation_impl
+
+/// Runs a program until it reads input or exhausts
+/// the step budget. The evaluation stops at the
+/// boundary of the root block instruction that could
+/// not be fully evaluated, so that the rest of the
+/// program can be resumed from there.
+constexpr partial_evaluation_t
+partially_evaluate(flat_ast_t const &ast,
+                   size_t step_budget) {
+  using namespace partial_evaluation_impl;
+
+  flat_blocks_t blocks = split_blocks(ast);
+  flat_ast_t const &root = blocks[0];
+
+  machine_t m{.steps_left = step_budget};
+  size_t pos = 0;
+
+  for (; pos < root.size(); pos++) {
+    // Loops and scans may stop midway, so the state
+    // has to be saved before running them.
+    bool const needs_snapshot =
+        holds_alternative<flat_while_t>(root[pos]) ||
+        holds_alternative<flat_scan_t>(root[pos]) ||
+        holds_alternative<flat_move_scan_t>(
+            root[pos]);
+
+    std::vector<char> tape_snapshot;
+    std::ptrdiff_t const pointer_snapshot = m.pointer;
+    size_t const output_size = m.output.size();
+    if (needs_snapshot) {
+      tape_snapshot = m.tape;
+    }
+
+    if (!exec(blocks, root[pos], m)) {
+      if (needs_snapshot) {
+        m.tape = std::move(tape_snapshot);
+        m.pointer = pointer_snapshot;
+        m.output.resize(output_size);
+      }
+      break;
+    }
+  }
+
+  // Trimming trailing zeros off the tape
+  while (!m.tape.empty() && m.tape.back() == 0) {
+    m.tape.pop_back();
+  }
+
+  blocks[0].erase(blocks[0].begin(),
+                  blocks[0].begin() + pos);
+
+  return {std::move(m.output), std::move(m.tape),
+          size_t(m.pointer), join_blocks(blocks)};
+}
+
+/// NTTP-compatible partial evaluation result.
+template <size_t OutputSize, size_t TapeSize,
+          size_t ResidualSize>
+struct fixed_partial_evaluation_t {
+  std::array<char, OutputSize> output;
+  std::array<char, TapeSize> tape;
+  size_t pointer;
+  fixed_flat_ast_t<ResidualSize> residual;
+};
+
+/// Parses and partially evaluates a BF program into
+/// a fixed_partial_evaluation_t value.
+template <auto const &ProgramString,
+          size_t StepBudget = default_step_budget>
+constexpr auto parse_to_fixed_partial_evaluation() {
+  // Getting sizes into constexpr variables
+  constexpr std::array<size_t, 3> Sizes = [] {
+    partial_evaluation_t const result =
+        partially_evaluate(
+            parse_to_flat_ast(ProgramString),
+            StepBudget);
+    return std::array<size_t, 3>{
+        result.output.size(), result.tape.size(),
+        result.residual.size()};
+  }();
+
+  fixed_partial_evaluation_t<Sizes[0], Sizes[1],
+                             Sizes[2]>
+      fixed;
+  partial_evaluation_t const result =
+      partially_evaluate(
+          parse_to_flat_ast(ProgramString),
+          StepBudget);
+  std::ranges::copy(result.output,
+                    fixed.output.begin());
+  std::ranges::copy(result.tape, fixed.tape.begin());
+  fixed.pointer = result.pointer;
+  std::ranges::copy(result.residual,
+                    fixed.residual.begin());
+
+  return fixed;
+}
+
+/// Partially evaluated program. The residual AST can
+/// be passed to any flat backend, to be run after the
+/// prelude.
+template <auto const &ProgramString,
+          size_t StepBudget = default_step_budget>
+struct partially_evaluated_program_t {
+  static constexpr auto evaluation =
+      parse_to_fixed_partial_evaluation<ProgramString,
+                                        StepBudget>();
+
+  /// Remaining instructions
+  static constexpr auto residual_ast =
+      evaluation.residual;
+
+  /// True if the whole program was evaluated
+  static constexpr bool complete =
+      get<flat_block_descriptor_t>(residual_ast[0])
+          .size == 0;
+
+  /// Writes the precomputed output, and restores the
+  /// tape state for the residual program.
+  template <typename State>
+  static void prelude(State &s) {
+    static_assert(sizeof(s.data[0]) == 1,
+                  "partial evaluation only supports "
+                  "byte cells");
+    static_assert(State::tape_size >=
+                      evaluation.tape.size(),
+                  "the state tape is too small");
+    output_text(s, evaluation.output.data(),
+                evaluation.output.size());
+
+    if constexpr (!complete) {
+      std::ranges::copy(evaluation.tape,
+                        s.data.begin());
+      s.i = evaluation.pointer;
+    }
+  }
+};
+
+} // namespace brainfuck::flat
@@ -0,0 +1,174 @@
+#pragma once
+
+// Pass manager for flat ASTs: optimization passes
+// are composed into a pipeline selected by an
+// optimization level, so that compile time can be
+// traded against runtime on a per-program basis.
+// Running a pipeline reports what each pass did to
+// the AST.
+
+#include <cstdint>
+#include <cstdio>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include <brainfuck/backends/flat/ast.hpp>
+#include <brainfuck/backends/flat/passes/bounds-checks.hpp>
+#include <brainfuck/backends/flat/passes/clear-loops.hpp>
+#include <brainfuck/backends/flat/passes/constant-propagation.hpp>
+#include <brainfuck/backends/flat/passes/dead-loops.hpp>
+#include <brainfuck/backends/flat/passes/deferred-moves.hpp>
+#include <brainfuck/backends/flat/passes/fold-runs.hpp>
+#include <brainfuck/backends/flat/passes/multiply-loops.hpp>
+#include <brainfuck/backends/flat/passes/scan-loops.hpp>
+#include <brainfuck/backends/flat/passes/superinstructions.hpp>
+
+namespace brainfuck::flat {
+
+/// Optimization levels, from the cheapest to compile
+/// to the fastest to run. Each level runs the passes
+/// of the previous one.
+enum optimization_level_t : unsigned {
+  /// No pass, the AST is the flattened program
+  o0_v,
+  /// Local rewrites: dead loops, folded runs, clear
+  /// loops and scan loops
+  o1_v,
+  /// Multiply loops, deferred pointer moves and
+  /// constant propagation
+  o2_v,
+  /// Superinstructions
+  o3_v,
+};
+
+inline constexpr optimization_level_t
+    default_optimization_level = o3_v;
+
+/// Optimization pass over a flat AST.
+struct pass_t {
+  std::string_view name;
+  flat_ast_t (*run)(flat_ast_t const &);
+};
+
+/// Returns the constant propagation pass for cells of
+/// cell_size bytes.
+constexpr pass_t
+constant_propagation_pass(size_t cell_size) {
+  using passes::propagate_constants;
+  switch (cell_size) {
+  case 2:
+    return {"constant-propagation",
+            propagate_constants<std::uint16_t>};
+  case 4:
+    return {"constant-propagation",
+            propagate_constants<std::uint32_t>};
+  case 8:
+    return {"constant-propagation",
+            propagate_constants<std::uint64_t>};
+  default:
+    return {"constant-propagation",
+            propagate_constants<std::uint8_t>};
+  }
+}
+
+/// Returns the passes run at a given optimization
+/// level, for cells of cell_size bytes. Bounds checks
+/// are inserted before superinstructions are formed,
+/// since they are positioned between unfused nodes.
+constexpr std::vector<pass_t>
+make_pipeline(optimization_level_t level,
+              bool bounds_checks = false,
+              size_t cell_size = 1) {
+  std::vector<pass_t> pipeline;
+
+  if (level >= o1_v) {
+    pipeline.push_back(
+        {"dead-loops", passes::remove_dead_loops});
+    pipeline.push_back(
+        {"fold-runs", passes::fold_runs});
+  }
+  if (level >= o2_v) {
+    pipeline.push_back(
+        {"multiply-loops",
+         passes::lower_multiply_loops});
+  }
+  if (level >= o1_v) {
+    pipeline.push_back(
+        {"clear-loops", passes::lower_clear_loops});
+    pipeline.push_back(
+        {"scan-loops", passes::lower_scan_loops});
+  }
+  if (level >= o2_v) {
+    pipeline.push_back({"deferred-moves",
+                        passes::defer_pointer_moves});
+    pipeline.push_back(
+        constant_propagation_pass(cell_size));
+  }
+  if (bounds_checks) {
+    pipeline.push_back(
+        {"bounds-checks", [](flat_ast_t const &ast) {
+           return passes::insert_bounds_checks(ast);
+         }});
+  }
+  if (level >= o3_v) {
+    pipeline.push_back(
+        {"superinstructions",
+         passes::form_superinstructions});
+  }
+
+  return pipeline;
+}
+
+/// What a pass did to an AST.
+struct pass_report_t {
+  std::string_view name;
+  size_t nodes_before;
+  size_t nodes_after;
+
+  constexpr std::ptrdiff_t node_reduction() const {
+    return std::ptrdiff_t(nodes_before) -
+           std::ptrdiff_t(nodes_after);
+  }
+};
+
+/// Result of a pipeline run.
+struct pipeline_result_t {
+  flat_ast_t ast;
+
+  /// One report per pass, in pipeline order
+  std::vector<pass_report_t> reports;
+};
+
+/// Runs a pipeline on a flat AST.
+constexpr pipeline_result_t
+run_pipeline(flat_ast_t ast,
+             std::span<pass_t const> pipeline) {
+  std::vector<pass_report_t> reports;
+  reports.reserve(pipeline.size());
+
+  for (pass_t const &pass : pipeline) {
+    size_t const nodes_before = ast.size();
+    ast = pass.run(ast);
+    reports.push_back(
+        {pass.name, nodes_before, ast.size()});
+  }
+
+  return {std::move(ast), std::move(reports)};
+}
+
+/// Prints pass reports, one line per pass.
+inline void print_pass_reports(
+    std::span<pass_report_t const> reports,
+    std::FILE *stream = stderr) {
+  for (pass_report_t const &report : reports) {
+    std::fprintf(
+        stream,
+        "%-22.*s %6zu -> %6zu nodes (%+td)\n",
+        int(report.name.size()), report.name.data(),
+        report.nodes_before, report.nodes_after,
+        -report.node_reduction());
+  }
+}
+
+} // namespace brainfuck::flat
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <brainfuck/backends/flat/ast.hpp>
+#include <brainfuck/backends/flat/tape-bounds.hpp>
+#include <brainfuck/program.hpp>
+
+namespace brainfuck::flat::passes {
+
+/// Inserts flat_check_t nodes before the accesses
+/// that are not proven to be in a tape of the given
+/// size, see tape-bounds.hpp. Programs whose accesses
+/// are all proven are left untouched. Expects
+/// propagate_constants output, and must run before
+/// form_superinstructions.
+constexpr flat_ast_t insert_bounds_checks(
+    flat_ast_t const &ast,
+    size_t tape_size = default_tape_size) {
+  flat_blocks_t blocks = split_blocks(ast);
+
+  tape_bounds_impl::walker_t walker{blocks,
+                                    tape_size};
+  walker.walk(0, 0);
+
+  for (size_t block_id = 0; block_id < blocks.size();
+       block_id++) {
+    std::vector<
+        tape_bounds_impl::check_insertion_t> const
+        &checks = walker.checks[block_id];
+    if (checks.empty()) {
+      continue;
+    }
+
+    flat_ast_t checked;
+    checked.reserve(blocks[block_id].size() +
+                    checks.size());
+
+    // Checks may be inserted at the end of the block
+    // if they only cover the loop guard
+    auto check = checks.begin();
+    for (size_t pos = 0;
+         pos <= blocks[block_id].size(); pos++) {
+      for (; check != checks.end() &&
+             check->pos == pos;
+           check++) {
+        checked.push_back(check->check);
+      }
+      if (pos < blocks[block_id].size()) {
+        checked.push_back(blocks[block_id][pos]);
+      }
+    }
+
+    blocks[block_id] = std::move(checked);
+  }
+
+  return join_blocks(blocks);
+}
+
+} // namespace brainfuck::flat::passes
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <brainfuck/backends/flat/ast.hpp>
+
+namespace brainfuck::flat::passes {
+
+/// Returns true if the block is a clear loop body,
+/// ie. a single odd increment such as [-] or [+].
+/// Odd increments always reach zero, whatever the
+/// initial value of the cell.
+constexpr bool
+is_clear_loop_body(flat_ast_t const &body) {
+  return body.size() == 1 &&
+         holds_alternative<flat_add_t>(body[0]) &&
+         get<flat_add_t>(body[0]).offset == 0 &&
+         get<flat_add_t>(body[0]).value % 2 != 0;
+}
+
+/// Replaces clear loops with flat_set_t nodes, and
+/// merges the flat_add_t nodes that follow them into
+/// the constant. Expects fold_runs output.
+constexpr flat_ast_t
+lower_clear_loops(flat_ast_t const &ast) {
+  flat_blocks_t blocks = split_blocks(ast);
+
+  for (flat_ast_t &block : blocks) {
+    flat_ast_t lowered;
+    lowered.reserve(block.size());
+
+    for (flat_node_t const &node : block) {
+      // [-] or [+]
+      if (holds_alternative<flat_while_t>(node) &&
+          is_clear_loop_body(
+              blocks[get<flat_while_t>(node)
+                         .block_begin])) {
+        lowered.push_back(flat_set_t{0});
+      }
+
+      // Constant followed by an increment
+      else if (holds_alternative<flat_add_t>(node) &&
+               !lowered.empty() &&
+               holds_alternative<flat_set_t>(
+                   lowered.back()) &&
+               get<flat_set_t>(lowered.back())
+                       .offset ==
+                   get<flat_add_t>(node).offset) {
+        get<flat_set_t>(lowered.back()).value +=
+            get<flat_add_t>(node).value;
+      }
+
+      else {
+        lowered.push_back(node);
+      }
+    }
+
+    block = std::move(lowered);
+  }
+
+  return join_blocks(blocks);
+}
+
+} // namespace brainfuck::flat::passes
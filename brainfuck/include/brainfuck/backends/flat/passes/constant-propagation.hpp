@@ -0,0 +1,310 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <optional>
+
+#include <brainfuck/backends/flat/ast.hpp>
+
+namespace brainfuck::flat::passes {
+
+namespace constant_propagation_impl {
+
+/// Known value of a cell, relative to the pointer
+/// position at the beginning of the current frame.
+template <typename Cell> struct cell_value_t {
+  std::ptrdiff_t offset;
+  std::optional<Cell> value;
+
+  /// True if the value is not stored on the tape yet
+  bool dirty = false;
+};
+
+/// Abstract tape state.
+template <typename Cell> struct known_cells_t {
+  std::vector<cell_value_t<Cell>> cells;
+
+  /// True if cells that are not in the cells vector
+  /// are known to be zero, which only holds at the
+  /// beginning of the program.
+  bool default_zero = false;
+
+  constexpr std::optional<Cell>
+  get(std::ptrdiff_t offset) const {
+    auto it = std::ranges::find(
+        cells, offset, &cell_value_t<Cell>::offset);
+    if (it != cells.end()) {
+      return it->value;
+    }
+    if (default_zero) {
+      return 0;
+    }
+    return std::nullopt;
+  }
+
+  constexpr void
+  set(std::ptrdiff_t offset,
+      std::optional<Cell> value,
+      bool dirty = false) {
+    auto it = std::ranges::find(
+        cells, offset, &cell_value_t<Cell>::offset);
+    if (it != cells.end()) {
+      it->value = value;
+      it->dirty = dirty;
+    } else {
+      cells.push_back({offset, value, dirty});
+    }
+  }
+
+  /// Forgets everything, and starts a new frame in
+  /// which the current cell is zero.
+  constexpr void reset_to_zero_cell() {
+    cells = {{0, 0}};
+    default_zero = false;
+  }
+};
+
+/// Returns the cells written by a loop body relative
+/// to the pointer, or nothing if the pointer position
+/// is not the same after the loop.
+constexpr std::optional<std::vector<std::ptrdiff_t>>
+written_cells(flat_blocks_t const &blocks,
+              size_t block_id) {
+  std::vector<std::ptrdiff_t> written;
+  std::ptrdiff_t pointer = 0;
+
+  for (flat_node_t const &node : blocks[block_id]) {
+    if (holds_alternative<flat_move_t>(node)) {
+      pointer += get<flat_move_t>(node).offset;
+    } else if (holds_alternative<flat_token_t>(
+                   node)) {
+      flat_token_t const &token =
+          get<flat_token_t>(node);
+      if (token.token == pointer_increase_v) {
+        pointer++;
+      } else if (token.token == pointer_decrease_v) {
+        pointer--;
+      } else if (token.token != put_v) {
+        written.push_back(pointer + token.offset);
+      }
+    } else if (holds_alternative<flat_add_t>(node)) {
+      written.push_back(pointer +
+                        get<flat_add_t>(node).offset);
+    } else if (holds_alternative<flat_set_t>(node)) {
+      written.push_back(pointer +
+                        get<flat_set_t>(node).offset);
+    } else if (holds_alternative<flat_mul_add_t>(
+                   node)) {
+      written.push_back(
+          pointer + get<flat_mul_add_t>(node).offset);
+    } else if (holds_alternative<flat_while_t>(
+                   node)) {
+      std::optional<std::vector<std::ptrdiff_t>>
+          nested = written_cells(
+              blocks,
+              get<flat_while_t>(node).block_begin);
+      if (!nested) {
+        return std::nullopt;
+      }
+      for (std::ptrdiff_t offset : *nested) {
+        written.push_back(pointer + offset);
+      }
+    } else if (holds_alternative<flat_scan_t>(node)) {
+      return std::nullopt;
+    }
+  }
+
+  if (pointer != 0) {
+    return std::nullopt;
+  }
+  return written;
+}
+
+} // namespace constant_propagation_impl
+
+/// Tracks statically known cell values through each
+/// block, starting from a zero tape for the root
+/// block and from an unknown tape for loop bodies.
+/// Arithmetic on known cells is folded, and the
+/// resulting stores are delayed until the tape is
+/// read by a loop, a scan, or the end of the block,
+/// including the end of the program.
+/// Loops whose guard is known to be zero are removed,
+/// and outputs of known values become flat_print_t
+/// nodes, so that consecutive outputs can be written
+/// at once. Cell is the unsigned type of the cells,
+/// whose arithmetic wraps around like the tape's.
+template <typename Cell = std::uint8_t>
+constexpr flat_ast_t
+propagate_constants(flat_ast_t const &ast) {
+  using namespace constant_propagation_impl;
+
+  flat_blocks_t blocks = split_blocks(ast);
+
+  for (size_t block_id = 0; block_id < blocks.size();
+       block_id++) {
+    flat_ast_t propagated;
+    propagated.reserve(blocks[block_id].size());
+
+    known_cells_t<Cell> known{
+        .cells = {}, .default_zero = block_id == 0};
+
+    // Pointer position relative to the current frame
+    std::ptrdiff_t pointer = 0;
+
+    // Records a cell store, to be emitted by flush
+    auto store = [&](std::ptrdiff_t offset,
+                     Cell value) {
+      if (known.get(pointer + offset) != value) {
+        known.set(pointer + offset, value, true);
+      }
+    };
+
+    // Emits the delayed stores of the given cell
+    auto flush_cell = [&](std::ptrdiff_t offset) {
+      for (cell_value_t<Cell> &cell : known.cells) {
+        if (cell.offset == pointer + offset &&
+            cell.dirty) {
+          propagated.push_back(
+              flat_set_t{int(*cell.value), offset});
+          cell.dirty = false;
+        }
+      }
+    };
+
+    // Emits all the delayed stores
+    auto flush = [&]() {
+      for (cell_value_t<Cell> &cell : known.cells) {
+        if (cell.dirty) {
+          propagated.push_back(
+              flat_set_t{int(*cell.value),
+                         cell.offset - pointer});
+          cell.dirty = false;
+        }
+      }
+    };
+
+    for (flat_node_t const &node : blocks[block_id]) {
+      if (holds_alternative<flat_move_t>(node)) {
+        pointer += get<flat_move_t>(node).offset;
+        propagated.push_back(node);
+      }
+
+      else if (holds_alternative<flat_add_t>(node)) {
+        flat_add_t const &add = get<flat_add_t>(node);
+        if (std::optional<Cell> value =
+                known.get(pointer + add.offset)) {
+          store(add.offset,
+                Cell(*value + add.value));
+        } else {
+          propagated.push_back(node);
+        }
+      }
+
+      else if (holds_alternative<flat_set_t>(node)) {
+        flat_set_t const &set = get<flat_set_t>(node);
+        store(set.offset, Cell(set.value));
+      }
+
+      else if (holds_alternative<flat_mul_add_t>(
+                   node)) {
+        flat_mul_add_t const &mul_add =
+            get<flat_mul_add_t>(node);
+        std::optional<Cell> source =
+            known.get(pointer + mul_add.source);
+        std::optional<Cell> target =
+            known.get(pointer + mul_add.offset);
+
+        if (source && target) {
+          int const scaled = mul_add.factor * *source;
+          store(mul_add.offset,
+                Cell(*target + scaled));
+        } else if (source && *source != 0) {
+          propagated.push_back(flat_add_t{
+              int(mul_add.factor * *source),
+              mul_add.offset});
+        } else if (!source) {
+          flush_cell(mul_add.offset);
+          propagated.push_back(node);
+          known.set(pointer + mul_add.offset,
+                    std::nullopt);
+        }
+      }
+
+      else if (holds_alternative<flat_token_t>(
+                   node)) {
+        flat_token_t const &token =
+            get<flat_token_t>(node);
+        std::optional<Cell> value =
+            known.get(pointer + token.offset);
+
+        if (token.token == put_v && value) {
+          propagated.push_back(
+              flat_print_t{char(*value)});
+        } else if (token.token == put_v) {
+          propagated.push_back(node);
+        } else if (token.token == get_v) {
+          propagated.push_back(node);
+          known.set(pointer + token.offset,
+                    std::nullopt);
+        }
+
+        // Unfolded tokens, should not happen after
+        // fold_runs
+        else {
+          flush();
+          propagated.push_back(node);
+          known = {};
+          pointer = 0;
+        }
+      }
+
+      else if (holds_alternative<flat_scan_t>(node)) {
+        if (known.get(pointer) != 0) {
+          flush();
+          propagated.push_back(node);
+          known.reset_to_zero_cell();
+          pointer = 0;
+        }
+      }
+
+      else if (holds_alternative<flat_while_t>(
+                   node)) {
+        // Loops never run if their guard is zero
+        if (known.get(pointer) == 0) {
+          continue;
+        }
+        flush();
+        propagated.push_back(node);
+
+        std::optional<std::vector<std::ptrdiff_t>>
+            written = written_cells(
+                blocks,
+                get<flat_while_t>(node).block_begin);
+        if (written) {
+          for (std::ptrdiff_t offset : *written) {
+            known.set(pointer + offset, std::nullopt);
+          }
+          known.set(pointer, 0);
+        } else {
+          known.reset_to_zero_cell();
+          pointer = 0;
+        }
+      }
+
+      else {
+        flush();
+        propagated.push_back(node);
+      }
+    }
+
+    // The final tape is observable, so stores at the
+    // end of the program are kept too
+    flush();
+    blocks[block_id] = std::move(propagated);
+  }
+
+  return join_blocks(blocks);
+}
+
+} // namespace brainfuck::flat::passes
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <brainfuck/backends/flat/ast.hpp>
+
+namespace brainfuck::flat::passes {
+
+/// Removes loops that can never run, ie. loops that
+/// directly follow another loop since the current
+/// cell is zero when a loop exits, and loops at the
+/// beginning of the program since the tape is
+/// zero-initialized. The bodies of removed loops are
+/// dropped by join_blocks.
+constexpr flat_ast_t
+remove_dead_loops(flat_ast_t const &ast) {
+  flat_blocks_t blocks = split_blocks(ast);
+
+  for (size_t block_id = 0; block_id < blocks.size();
+       block_id++) {
+    flat_ast_t live;
+    live.reserve(blocks[block_id].size());
+
+    // True if the current cell is known to be zero
+    bool zero_cell = block_id == 0;
+
+    for (flat_node_t const &node : blocks[block_id]) {
+      if (!holds_alternative<flat_while_t>(node)) {
+        live.push_back(node);
+        zero_cell = false;
+      } else if (!zero_cell) {
+        live.push_back(node);
+        zero_cell = true;
+      }
+    }
+
+    blocks[block_id] = std::move(live);
+  }
+
+  return join_blocks(blocks);
+}
+
+} // namespace brainfuck::flat::passes
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <brainfuck/backends/flat/ast.hpp>
+
+namespace brainfuck::flat::passes {
+
+/// Tracks a virtual pointer offset through each
+/// block, turning pointer moves into cell offsets on
+/// the instructions that follow them. The pointer is
+/// only moved once before loops, scans, and at the
+/// end of each block.
+constexpr flat_ast_t
+defer_pointer_moves(flat_ast_t const &ast) {
+  flat_blocks_t blocks = split_blocks(ast);
+
+  for (flat_ast_t &block : blocks) {
+    flat_ast_t deferred;
+    deferred.reserve(block.size());
+
+    // Pending pointer move
+    std::ptrdiff_t offset = 0;
+
+    auto flush = [&]() {
+      if (offset != 0) {
+        deferred.push_back(flat_move_t{offset});
+        offset = 0;
+      }
+    };
+
+    for (flat_node_t node : block) {
+      if (holds_alternative<flat_move_t>(node)) {
+        offset += get<flat_move_t>(node).offset;
+      } else if (holds_alternative<flat_token_t>(
+                     node) &&
+                 get<flat_token_t>(node).token ==
+                     pointer_increase_v) {
+        offset++;
+      } else if (holds_alternative<flat_token_t>(
+                     node) &&
+                 get<flat_token_t>(node).token ==
+                     pointer_decrease_v) {
+        offset--;
+      } else if (holds_alternative<flat_token_t>(
+                     node)) {
+        get<flat_token_t>(node).offset += offset;
+        deferred.push_back(node);
+      } else if (holds_alternative<flat_add_t>(
+                     node)) {
+        get<flat_add_t>(node).offset += offset;
+        deferred.push_back(node);
+      } else if (holds_alternative<flat_set_t>(
+                     node)) {
+        get<flat_set_t>(node).offset += offset;
+        deferred.push_back(node);
+      } else if (holds_alternative<flat_mul_add_t>(
+                     node)) {
+        get<flat_mul_add_t>(node).offset += offset;
+        get<flat_mul_add_t>(node).source += offset;
+        deferred.push_back(node);
+      }
+
+      // Loops and scans need the actual pointer
+      else {
+        flush();
+        deferred.push_back(node);
+      }
+    }
+
+    flush();
+    block = std::move(deferred);
+  }
+
+  return join_blocks(blocks);
+}
+
+} // namespace brainfuck::flat::passes
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <brainfuck/backends/flat/ast.hpp>
+
+namespace brainfuck::flat::passes {
+
+/// Folds runs of +/- tokens into flat_add_t nodes,
+/// and runs of >/< tokens into flat_move_t nodes.
+/// Runs that cancel out are removed altogether.
+constexpr flat_ast_t
+fold_runs(flat_ast_t const &ast) {
+  flat_blocks_t blocks = split_blocks(ast);
+
+  for (flat_ast_t &block : blocks) {
+    flat_ast_t folded;
+    folded.reserve(block.size());
+
+    for (flat_node_t const &node : block) {
+      // Turning tokens into their counted form
+      flat_node_t counted = node;
+      if (holds_alternative<flat_token_t>(node)) {
+        flat_token_t const &token =
+            get<flat_token_t>(node);
+        switch (token.token) {
+        case pointee_increase_v:
+          counted = flat_add_t{1, token.offset};
+          break;
+        case pointee_decrease_v:
+          counted = flat_add_t{-1, token.offset};
+          break;
+        case pointer_increase_v:
+          counted = flat_move_t{1};
+          break;
+        case pointer_decrease_v:
+          counted = flat_move_t{-1};
+          break;
+        default:
+          break;
+        }
+      }
+
+      // Merging with the previous node if both are
+      // of the same kind
+      if (holds_alternative<flat_add_t>(counted) &&
+          !folded.empty() &&
+          holds_alternative<flat_add_t>(
+              folded.back()) &&
+          get<flat_add_t>(folded.back()).offset ==
+              get<flat_add_t>(counted).offset) {
+        int &value =
+            get<flat_add_t>(folded.back()).value;
+        value += get<flat_add_t>(counted).value;
+        if (value == 0) {
+          folded.pop_back();
+        }
+      } else if (holds_alternative<flat_move_t>(
+                     counted) &&
+                 !folded.empty() &&
+                 holds_alternative<flat_move_t>(
+                     folded.back())) {
+        std::ptrdiff_t &offset =
+            get<flat_move_t>(folded.back()).offset;
+        offset += get<flat_move_t>(counted).offset;
+        if (offset == 0) {
+          folded.pop_back();
+        }
+      } else {
+        folded.push_back(counted);
+      }
+    }
+
+    block = std::move(folded);
+  }
+
+  return join_blocks(blocks);
+}
+
+} // namespace brainfuck::flat::passes
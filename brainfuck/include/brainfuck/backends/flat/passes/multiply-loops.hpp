@@ -0,0 +1,107 @@
+#pragma once
+
+#include <algorithm>
+#include <optional>
+
+#include <brainfuck/backends/flat/ast.hpp>
+
+namespace brainfuck::flat::passes {
+
+/// Cell increment of a multiply loop body, per cell
+/// offset relative to the loop's induction cell.
+struct cell_delta_t {
+  std::ptrdiff_t offset;
+  int delta;
+};
+
+/// Returns the per-iteration cell increments of a
+/// multiply loop body, ie. a balanced body made of
+/// flat_add_t and flat_move_t nodes only, or nothing
+/// if the body is not such a loop.
+constexpr std::optional<std::vector<cell_delta_t>>
+analyze_multiply_loop_body(flat_ast_t const &body) {
+  std::vector<cell_delta_t> deltas;
+  std::ptrdiff_t offset = 0;
+
+  for (flat_node_t const &node : body) {
+    if (holds_alternative<flat_move_t>(node)) {
+      offset += get<flat_move_t>(node).offset;
+    } else if (holds_alternative<flat_add_t>(node)) {
+      std::ptrdiff_t const cell =
+          offset + get<flat_add_t>(node).offset;
+      auto it = std::ranges::find(
+          deltas, cell, &cell_delta_t::offset);
+      if (it == deltas.end()) {
+        deltas.push_back({cell, 0});
+        it = deltas.end() - 1;
+      }
+      it->delta += get<flat_add_t>(node).value;
+    } else {
+      return std::nullopt;
+    }
+  }
+
+  if (offset != 0) {
+    return std::nullopt;
+  }
+
+  return deltas;
+}
+
+/// Lowers multiply loops such as [->+>++<<] into
+/// flat_mul_add_t updates followed by a clear of the
+/// induction cell. Loops whose induction cell is not
+/// incremented or decremented by one per iteration
+/// are kept as is. Expects fold_runs output.
+constexpr flat_ast_t
+lower_multiply_loops(flat_ast_t const &ast) {
+  flat_blocks_t blocks = split_blocks(ast);
+
+  for (flat_ast_t &block : blocks) {
+    flat_ast_t lowered;
+    lowered.reserve(block.size());
+
+    for (flat_node_t const &node : block) {
+      if (!holds_alternative<flat_while_t>(node)) {
+        lowered.push_back(node);
+        continue;
+      }
+
+      std::optional<std::vector<cell_delta_t>>
+          deltas = analyze_multiply_loop_body(
+              blocks[get<flat_while_t>(node)
+                         .block_begin]);
+
+      // Induction step
+      int step = 0;
+      if (deltas) {
+        auto it = std::ranges::find(
+            *deltas, 0, &cell_delta_t::offset);
+        step = it == deltas->end() ? 0 : it->delta;
+      }
+
+      if (step != 1 && step != -1) {
+        lowered.push_back(node);
+        continue;
+      }
+
+      // The loop runs cell[0] times when the
+      // induction cell is decremented, and -cell[0]
+      // times (modulo the cell width) when it is
+      // incremented.
+      for (cell_delta_t const &d : *deltas) {
+        if (d.offset != 0 && d.delta != 0) {
+          lowered.push_back(flat_mul_add_t{
+              d.offset, -step * d.delta});
+        }
+      }
+      lowered.push_back(flat_set_t{0});
+    }
+
+    block = std::move(lowered);
+  }
+
+  return join_blocks(blocks);
+}
+
+} // namespace brainfuck::flat::passes
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <brainfuck/backends/flat/ast.hpp>
+
+namespace brainfuck::flat::passes {
+
+/// Replaces loops whose body is a single pointer
+/// move, such as [>] or [<<<<<<<<<], with flat_scan_t
+/// nodes. Expects fold_runs output.
+constexpr flat_ast_t
+lower_scan_loops(flat_ast_t const &ast) {
+  flat_blocks_t blocks = split_blocks(ast);
+
+  for (flat_ast_t &block : blocks) {
+    for (flat_node_t &node : block) {
+      if (!holds_alternative<flat_while_t>(node)) {
+        continue;
+      }
+
+      flat_ast_t const &body =
+          blocks[get<flat_while_t>(node).block_begin];
+      if (body.size() == 1 &&
+          holds_alternative<flat_move_t>(body[0])) {
+        node = flat_scan_t{
+            get<flat_move_t>(body[0]).offset};
+      }
+    }
+  }
+
+  return join_blocks(blocks);
+}
+
+} // namespace brainfuck::flat::passes
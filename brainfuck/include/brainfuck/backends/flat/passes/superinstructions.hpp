@@ -0,0 +1,167 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <span>
+
+#include <brainfuck/backends/flat/ast.hpp>
+
+namespace brainfuck::flat::passes {
+
+namespace superinstructions_impl {
+
+/// Index of a node type in flat_node_t
+template <typename NodeType>
+inline constexpr size_t node_index_v =
+    flat_node_t(NodeType{}).index();
+
+/// Maximum number of nodes fused by a
+/// superinstruction
+inline constexpr size_t max_pattern_length = 2;
+
+/// Catalogue entry: a sequence of node types, an
+/// extra condition on the matched nodes, and the
+/// function that builds the fused node.
+struct superinstruction_t {
+  std::array<size_t, max_pattern_length> pattern;
+  size_t length;
+  bool (*matches)(std::span<flat_node_t const>);
+  flat_node_t (*fuse)(std::span<flat_node_t const>);
+};
+
+/// Superinstruction catalogue. Entries are tried in
+/// order at every position of a block, and the first
+/// one that matches wins.
+inline constexpr std::array
+    superinstruction_catalogue{
+    // >>[-]+ etc.
+    superinstruction_t{
+        .pattern = {node_index_v<flat_move_t>,
+                    node_index_v<flat_set_t>},
+        .length = 2,
+        .matches =
+            [](std::span<flat_node_t const>) {
+              return true;
+            },
+        .fuse =
+            [](std::span<flat_node_t const> nodes) {
+              return flat_node_t(flat_move_set_t{
+                  get<flat_move_t>(nodes[0]).offset,
+                  get<flat_set_t>(nodes[1]).value,
+                  get<flat_set_t>(nodes[1]).offset});
+            }},
+
+    // +++>> etc.
+    superinstruction_t{
+        .pattern = {node_index_v<flat_add_t>,
+                    node_index_v<flat_move_t>},
+        .length = 2,
+        .matches =
+            [](std::span<flat_node_t const>) {
+              return true;
+            },
+        .fuse =
+            [](std::span<flat_node_t const> nodes) {
+              return flat_node_t(flat_add_move_t{
+                  get<flat_add_t>(nodes[0]).value,
+                  get<flat_add_t>(nodes[0]).offset,
+                  get<flat_move_t>(nodes[1]).offset});
+            }},
+
+    // [->+<] etc.
+    superinstruction_t{
+        .pattern = {node_index_v<flat_mul_add_t>,
+                    node_index_v<flat_set_t>},
+        .length = 2,
+        .matches =
+            [](std::span<flat_node_t const> nodes) {
+              flat_set_t const &set =
+                  get<flat_set_t>(nodes[1]);
+              return set.value == 0 &&
+                     set.offset ==
+                         get<flat_mul_add_t>(nodes[0])
+                             .source;
+            },
+        .fuse =
+            [](std::span<flat_node_t const> nodes) {
+              flat_mul_add_t const &mul_add =
+                  get<flat_mul_add_t>(nodes[0]);
+              return flat_node_t(flat_mul_add_clear_t{
+                  mul_add.offset, mul_add.factor,
+                  mul_add.source});
+            }},
+
+    // >>[<] etc.
+    superinstruction_t{
+        .pattern = {node_index_v<flat_move_t>,
+                    node_index_v<flat_scan_t>},
+        .length = 2,
+        .matches =
+            [](std::span<flat_node_t const>) {
+              return true;
+            },
+        .fuse =
+            [](std::span<flat_node_t const> nodes) {
+              return flat_node_t(flat_move_scan_t{
+                  get<flat_move_t>(nodes[0]).offset,
+                  get<flat_scan_t>(nodes[1]).stride});
+            }},
+};
+
+/// Returns true if the superinstruction matches the
+/// beginning of the given nodes.
+constexpr bool
+matches(superinstruction_t const &entry,
+        std::span<flat_node_t const> nodes) {
+  if (nodes.size() < entry.length) {
+    return false;
+  }
+  for (size_t k = 0; k < entry.length; k++) {
+    if (nodes[k].index() != entry.pattern[k]) {
+      return false;
+    }
+  }
+  return entry.matches(nodes.first(entry.length));
+}
+
+} // namespace superinstructions_impl
+
+/// Fuses frequent node sequences into single nodes
+/// using superinstruction_catalogue. Expects the
+/// output of the other passes, and must run last
+/// since they do not handle fused nodes.
+constexpr flat_ast_t
+form_superinstructions(flat_ast_t const &ast) {
+  using namespace superinstructions_impl;
+
+  flat_blocks_t blocks = split_blocks(ast);
+
+  for (flat_ast_t &block : blocks) {
+    flat_ast_t fused;
+    fused.reserve(block.size());
+
+    std::span<flat_node_t const> rest = block;
+    while (!rest.empty()) {
+      auto const entry = std::ranges::find_if(
+          superinstruction_catalogue,
+          [&](superinstruction_t const &e) {
+            return matches(e, rest);
+          });
+
+      if (entry != superinstruction_catalogue.end()) {
+        fused.push_back(
+            entry->fuse(rest.first(entry->length)));
+        rest = rest.subspan(entry->length);
+      } else {
+        fused.push_back(rest.front());
+        rest = rest.subspan(1);
+      }
+    }
+
+    block = std::move(fused);
+  }
+
+  return join_blocks(blocks);
+}
+
+} // namespace brainfuck::flat::passes
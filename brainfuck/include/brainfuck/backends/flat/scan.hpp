@@ -0,0 +1,238 @@
+#pragma once
+
+// Scan loop kernels, ie. implementations of [>], [<],
+// [>>>] etc. that look for the first zero cell
+// reachable from the current position with a given
+// stride.
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <span>
+#include <type_traits>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace brainfuck::flat {
+
+namespace scan_impl {
+
+using std::size_t;
+
+/// Scalar scan, also used in constant evaluation
+/// and for cells wider than a byte. Returns the first
+/// position out of the tape if no zero cell is found.
+template <std::ptrdiff_t Stride, typename Cell>
+constexpr size_t
+scalar_scan(std::span<Cell const> tape, size_t i) {
+  while (i < tape.size() && tape[i] != 0) {
+    i += Stride;
+  }
+  return i;
+}
+
+#if defined(__AVX2__)
+
+/// Forward or backward scan with a stride larger
+/// than 1, checking 8 cells at a time with a gather.
+template <std::ptrdiff_t Stride>
+size_t gather_scan(std::span<char const> tape,
+                   size_t i) {
+  constexpr std::ptrdiff_t Span = 7 * Stride;
+  __m256i const indexes = _mm256_setr_epi32(
+      0, Stride, 2 * Stride, 3 * Stride, 4 * Stride,
+      5 * Stride, 6 * Stride, 7 * Stride);
+  __m256i const byte_mask = _mm256_set1_epi32(0xff);
+
+  // Every gathered lane reads 4 bytes
+  auto in_bounds = [&](size_t pos) {
+    std::ptrdiff_t const last =
+        std::ptrdiff_t(pos) + (Span > 0 ? Span : 0);
+    std::ptrdiff_t const first =
+        std::ptrdiff_t(pos) + (Span < 0 ? Span : 0);
+    return first >= 0 &&
+           last + 3 < std::ptrdiff_t(tape.size());
+  };
+
+  while (in_bounds(i)) {
+    __m256i const cells = _mm256_and_si256(
+        _mm256_i32gather_epi32(
+            reinterpret_cast<int const *>(
+                tape.data() + i),
+            indexes, 1),
+        byte_mask);
+    unsigned const zeros =
+        unsigned(_mm256_movemask_ps(
+            _mm256_castsi256_ps(_mm256_cmpeq_epi32(
+                cells, _mm256_setzero_si256()))));
+    if (zeros != 0) {
+      return i + std::countr_zero(zeros) * Stride;
+    }
+    i += 8 * Stride;
+  }
+
+  return scalar_scan<Stride>(tape, i);
+}
+
+#elif defined(__SSE2__)
+
+/// Forward or backward scan with a stride smaller
+/// than 16, checking a 16 byte window at a time and
+/// masking out the cells that are not on the stride.
+template <std::ptrdiff_t Stride>
+size_t gather_scan(std::span<char const> tape,
+                   size_t i) {
+  constexpr size_t AbsStride =
+      Stride > 0 ? Stride : -Stride;
+
+  if constexpr (AbsStride >= 16) {
+    return scalar_scan<Stride>(tape, i);
+  } else {
+    // Number of strided cells in a window
+    constexpr size_t Lanes = (15 / AbsStride) + 1;
+
+    // Bits of the strided cells in a window, starting
+    // from the lowest bit for forward scans and from
+    // the highest one for backward scans
+    constexpr unsigned Mask = [] {
+      unsigned mask = 0;
+      for (size_t lane = 0; lane < Lanes; lane++) {
+        mask |= 1u << (Stride > 0
+                           ? lane * AbsStride
+                           : 15 - lane * AbsStride);
+      }
+      return mask;
+    }();
+
+    if constexpr (Stride > 0) {
+      while (i + 16 <= tape.size()) {
+        __m128i const cells = _mm_loadu_si128(
+            reinterpret_cast<__m128i const *>(
+                tape.data() + i));
+        unsigned const zeros =
+            unsigned(_mm_movemask_epi8(_mm_cmpeq_epi8(
+                cells, _mm_setzero_si128()))) &
+            Mask;
+        if (zeros != 0) {
+          return i + std::countr_zero(zeros);
+        }
+        i += Lanes * AbsStride;
+      }
+    } else {
+      while (i >= 15 && i < tape.size()) {
+        __m128i const cells = _mm_loadu_si128(
+            reinterpret_cast<__m128i const *>(
+                tape.data() + i - 15));
+        unsigned const zeros =
+            unsigned(_mm_movemask_epi8(_mm_cmpeq_epi8(
+                cells, _mm_setzero_si128()))) &
+            Mask;
+        if (zeros != 0) {
+          return i - 15 +
+                 (31 - std::countl_zero(zeros));
+        }
+        i -= Lanes * AbsStride;
+      }
+    }
+
+    return scalar_scan<Stride>(tape, i);
+  }
+}
+
+#else
+
+template <std::ptrdiff_t Stride>
+size_t gather_scan(std::span<char const> tape,
+                   size_t i) {
+  return scalar_scan<Stride>(tape, i);
+}
+
+#endif
+
+} // namespace scan_impl
+
+/// Returns the position of the first zero cell
+/// reachable from position i by steps of Stride.
+/// If there is none, the returned position is out of
+/// the tape just like the pointer would be after
+/// running the original loop. The tape is a
+/// contiguous range of cells, and vectorized kernels
+/// are only used for byte cells.
+template <std::ptrdiff_t Stride, typename Tape>
+constexpr std::size_t scan(Tape const &cells,
+                           std::size_t i) {
+  using cell_t = std::remove_cvref_t<
+      decltype(*std::data(cells))>;
+  std::span<cell_t const> const view(
+      std::data(cells), std::size(cells));
+
+  if constexpr (sizeof(cell_t) != 1) {
+    return scan_impl::scalar_scan<Stride>(view, i);
+  } else {
+    if consteval {
+      return scan_impl::scalar_scan<Stride>(view, i);
+    }
+
+    std::span<char const> const tape(
+        reinterpret_cast<char const *>(view.data()),
+        view.size());
+    if (i >= tape.size()) {
+      return i;
+    }
+
+    if constexpr (Stride == 1) {
+      void const *zero = std::memchr(
+          tape.data() + i, 0, tape.size() - i);
+      return zero == nullptr
+                 ? tape.size()
+                 : static_cast<char const *>(zero) -
+                       tape.data();
+    }
+#if defined(__GLIBC__)
+    else if constexpr (Stride == -1) {
+      void const *zero =
+          ::memrchr(tape.data(), 0, i + 1);
+      return zero == nullptr
+                 ? std::size_t(-1)
+                 : static_cast<char const *>(zero) -
+                       tape.data();
+    }
+#endif
+    else {
+      return scan_impl::gather_scan<Stride>(tape, i);
+    }
+  }
+}
+
+/// Runtime stride version of scan, for backends that
+/// only know the stride at runtime. Common strides
+/// are forwarded to their compile-time kernels.
+template <typename Tape>
+std::size_t scan(Tape const &tape, std::size_t i,
+                 std::ptrdiff_t stride) {
+  switch (stride) {
+  case 1:
+    return scan<1>(tape, i);
+  case -1:
+    return scan<-1>(tape, i);
+  case 2:
+    return scan<2>(tape, i);
+  case -2:
+    return scan<-2>(tape, i);
+  case 4:
+    return scan<4>(tape, i);
+  case -4:
+    return scan<-4>(tape, i);
+  default:
+    while (i < std::size(tape) && tape[i] != 0) {
+      i += stride;
+    }
+    return i;
+  }
+}
+
+} // namespace brainfuck::flat
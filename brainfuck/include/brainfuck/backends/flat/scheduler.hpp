@@ -0,0 +1,204 @@
+#pragma once
+
+// Cooperative scheduler for running many bytecode
+// programs concurrently. Each program is a resumable
+// job that runs for a slice of instructions before
+// going back to the end of its worker's run queue.
+// Workers that run out of jobs steal them from the
+// other workers, so runaway programs cannot starve
+// the others and cores are kept busy with many small
+// jobs.
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stop_token>
+#include <thread>
+#include <vector>
+
+#include <brainfuck/backends/flat/bytecode.hpp>
+#include <brainfuck/program.hpp>
+
+namespace brainfuck::flat::scheduler {
+
+/// Default number of instructions a job runs before
+/// giving its worker back, see
+/// bytecode::threaded_program_t::run_slice
+inline constexpr std::ptrdiff_t default_slice =
+    1 << 16;
+
+/// Returns the number of hardware threads, or 1 if
+/// it is unknown.
+inline std::size_t default_worker_count() {
+  unsigned const count =
+      std::thread::hardware_concurrency();
+  return count == 0 ? 1 : count;
+}
+
+/// Resumable execution of a program.
+template <typename State = program_state_t>
+struct job_t {
+  std::shared_ptr<
+      bytecode::threaded_program_t<State> const>
+      program;
+
+  /// Allocated on submission if null
+  std::unique_ptr<State> state;
+
+  /// Instruction to resume at
+  std::size_t pc = 0;
+
+  /// Called by the worker that runs the end of the
+  /// program
+  std::function<void(job_t &)> on_done;
+};
+
+/// Work-stealing scheduler. Jobs are run by a fixed
+/// set of worker threads, and the destructor waits
+/// for all submitted jobs to be done.
+template <typename State = program_state_t>
+class scheduler_t {
+public:
+  using job_type = job_t<State>;
+
+  explicit scheduler_t(
+      std::size_t worker_count =
+          default_worker_count(),
+      std::ptrdiff_t slice = default_slice)
+      : slice_(slice), queues_(worker_count) {
+    workers_.reserve(worker_count);
+    for (std::size_t k = 0; k < worker_count; k++) {
+      workers_.emplace_back(
+          [this, k](std::stop_token stop) {
+            work(stop, k);
+          });
+    }
+  }
+
+  scheduler_t(scheduler_t const &) = delete;
+  scheduler_t &
+  operator=(scheduler_t const &) = delete;
+
+  ~scheduler_t() { wait(); }
+
+  /// Adds a job to the run queues. Jobs are spread
+  /// across workers in a round-robin fashion.
+  void submit(job_type job) {
+    if (job.state == nullptr) {
+      job.state = std::make_unique<State>();
+    }
+    pending_++;
+    push(next_queue_++ % queues_.size(),
+         std::move(job));
+  }
+
+  /// Blocks until all submitted jobs are done.
+  void wait() {
+    std::unique_lock lock(mutex_);
+    done_.wait(lock,
+               [this] { return pending_ == 0; });
+  }
+
+private:
+  /// Run queue of a worker. The worker takes jobs
+  /// from the front, and thieves from the back.
+  struct queue_t {
+    std::mutex mutex;
+    std::deque<job_type> jobs;
+  };
+
+  /// Queues a job on a worker, and wakes up an idle
+  /// worker. Jobs that are requeued after a slice
+  /// wake one up too, since other workers may be
+  /// idle while the current one keeps busy.
+  void push(std::size_t worker, job_type job) {
+    queued_++;
+    {
+      std::lock_guard lock(queues_[worker].mutex);
+      queues_[worker].jobs.push_back(std::move(job));
+    }
+
+    std::lock_guard lock(mutex_);
+    work_available_.notify_one();
+  }
+
+  /// Takes a job from the queue of a worker, or
+  /// steals one from another worker.
+  std::optional<job_type> pop(std::size_t worker) {
+    for (std::size_t k = 0; k < queues_.size(); k++) {
+      queue_t &queue =
+          queues_[(worker + k) % queues_.size()];
+      std::lock_guard lock(queue.mutex);
+      if (queue.jobs.empty()) {
+        continue;
+      }
+
+      std::optional<job_type> job;
+      if (k == 0) {
+        job = std::move(queue.jobs.front());
+        queue.jobs.pop_front();
+      } else {
+        job = std::move(queue.jobs.back());
+        queue.jobs.pop_back();
+      }
+      queued_--;
+      return job;
+    }
+    return std::nullopt;
+  }
+
+  void work(std::stop_token stop,
+            std::size_t worker) {
+    while (!stop.stop_requested()) {
+      std::optional<job_type> job = pop(worker);
+
+      if (!job) {
+        std::unique_lock lock(mutex_);
+        work_available_.wait(lock, stop, [this] {
+          return queued_ > 0;
+        });
+        continue;
+      }
+
+      if (!job->program->run_slice(*job->state,
+                                   job->pc, slice_)) {
+        push(worker, std::move(*job));
+        continue;
+      }
+
+      if (job->on_done) {
+        job->on_done(*job);
+      }
+      if (--pending_ == 0) {
+        std::lock_guard lock(mutex_);
+        done_.notify_all();
+      }
+    }
+  }
+
+  std::ptrdiff_t slice_;
+  std::vector<queue_t> queues_;
+  std::atomic<std::size_t> next_queue_ = 0;
+
+  /// Jobs in the run queues
+  std::atomic<std::size_t> queued_ = 0;
+
+  /// Jobs that are submitted and not done
+  std::atomic<std::size_t> pending_ = 0;
+
+  /// Guards the waits of idle workers and of wait
+  std::mutex mutex_;
+  std::condition_variable_any work_available_;
+  std::condition_variable done_;
+
+  /// Last member, so that workers are stopped and
+  /// joined before the rest is destroyed
+  std::vector<std::jthread> workers_;
+};
+
+} // namespace brainfuck::flat::scheduler
@@ -0,0 +1,598 @@
+#pragma once
+
+// SPMD flat backend: runs many instances of the same
+// program in lockstep, one per lane. The tapes of the
+// lanes are interleaved so that cell k of every lane
+// is contiguous, and operations are loops over the
+// lanes that the compiler turns into SIMD
+// instructions. Loops run under a lane mask until
+// their guard is zero in every lane.
+//
+// Lanes whose pointers are equal, which is the case
+// until control flow diverges, access a contiguous
+// row of cells. Otherwise each lane accesses its own
+// cell.
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include <brainfuck/backends/flat.hpp>
+
+namespace brainfuck::flat::spmd {
+
+/// Default number of lanes
+inline constexpr size_t default_lanes = 32;
+
+/// Lanes that run an operation, one bit per lane
+using lane_mask_t = std::uint64_t;
+
+/// Returns the mask where all of Lanes lanes are on.
+template <size_t Lanes>
+constexpr lane_mask_t full_mask() {
+  static_assert(Lanes > 0 && Lanes <= 64,
+                "lanes must fit in a lane_mask_t");
+  return Lanes == 64 ? ~lane_mask_t(0)
+                     : (lane_mask_t(1) << Lanes) - 1;
+}
+
+/// State of Lanes instances of a program. Cell k of
+/// lane l is data[k * Lanes + l].
+template <size_t Lanes = default_lanes,
+          size_t TapeSize = default_tape_size>
+struct basic_lanes_state_t {
+  static constexpr size_t lanes = Lanes;
+  static constexpr size_t tape_size = TapeSize;
+
+  std::vector<char> data =
+      std::vector<char>(TapeSize * Lanes);
+
+  /// Pointers of the lanes. Only the first one is
+  /// up to date when they are uniform.
+  std::array<size_t, Lanes> i{};
+
+  /// All the pointers are equal
+  bool uniform = true;
+
+  std::array<std::string_view, Lanes> input;
+  std::array<size_t, Lanes> input_pos{};
+  std::array<std::string, Lanes> output;
+
+  /// Clears the tapes and the outputs, and sets the
+  /// input of each lane.
+  void reset(std::span<std::string_view const, Lanes>
+                 records) {
+    std::ranges::fill(data, 0);
+    i = {};
+    uniform = true;
+    std::ranges::copy(records, input.begin());
+    input_pos = {};
+    for (std::string &lane_output : output) {
+      lane_output.clear();
+    }
+  }
+};
+
+using lanes_state_t = basic_lanes_state_t<>;
+
+namespace spmd_impl {
+
+/// Returns true if lane l of a mask is on.
+inline bool is_on(lane_mask_t m, size_t l) {
+  return (m >> l) & 1;
+}
+
+/// Calls f(l, cell) for every lane l of a mask, where
+/// cell(offset) is the cell at offset from the
+/// pointer of lane l.
+template <typename State, typename F>
+inline void for_lanes(State &s, lane_mask_t m, F f) {
+  constexpr size_t Lanes = State::lanes;
+  char *const data = s.data.data();
+
+  if (s.uniform) {
+    char *const row = data + s.i[0] * Lanes;
+    auto const cell = [row](size_t l) {
+      return [row, l](std::ptrdiff_t off) -> char & {
+        return row[off * std::ptrdiff_t(Lanes) + l];
+      };
+    };
+
+    // Separate loop without control flow, so that it
+    // is vectorized
+    if (m == full_mask<Lanes>()) {
+      for (size_t l = 0; l < Lanes; l++) {
+        f(l, cell(l));
+      }
+    } else {
+      for (size_t l = 0; l < Lanes; l++) {
+        if (is_on(m, l)) {
+          f(l, cell(l));
+        }
+      }
+    }
+  } else {
+    for (size_t l = 0; l < Lanes; l++) {
+      if (is_on(m, l)) {
+        f(l, [&](std::ptrdiff_t offset) -> char & {
+          return data[(s.i[l] + offset) * Lanes + l];
+        });
+      }
+    }
+  }
+}
+
+/// Returns the mask of the lanes of a row of cells
+/// that are not zero.
+template <size_t Lanes>
+inline lane_mask_t nonzero_mask(char const *row) {
+  lane_mask_t zeros = 0;
+  size_t l = 0;
+
+#if defined(__AVX2__)
+  for (; l + 32 <= Lanes; l += 32) {
+    __m256i const cells = _mm256_loadu_si256(
+        reinterpret_cast<__m256i const *>(row + l));
+    __m256i const is_zero = _mm256_cmpeq_epi8(
+        cells, _mm256_setzero_si256());
+    zeros |= lane_mask_t(unsigned(
+                 _mm256_movemask_epi8(is_zero)))
+             << l;
+  }
+#endif
+#if defined(__SSE2__)
+  for (; l + 16 <= Lanes; l += 16) {
+    __m128i const cells = _mm_loadu_si128(
+        reinterpret_cast<__m128i const *>(row + l));
+    __m128i const is_zero =
+        _mm_cmpeq_epi8(cells, _mm_setzero_si128());
+    zeros |= lane_mask_t(unsigned(
+                 _mm_movemask_epi8(is_zero)))
+             << l;
+  }
+#endif
+
+  for (; l < Lanes; l++) {
+    zeros |= lane_mask_t(row[l] == 0) << l;
+  }
+  return ~zeros & full_mask<Lanes>();
+}
+
+/// Returns the lanes of a mask where the current
+/// cell is not zero.
+template <typename State>
+inline lane_mask_t guard_mask(State const &s,
+                              lane_mask_t m) {
+  constexpr size_t Lanes = State::lanes;
+  char const *const data = s.data.data();
+
+  if (s.uniform) {
+    return m & nonzero_mask<Lanes>(data +
+                                   s.i[0] * Lanes);
+  }
+
+  lane_mask_t guard = 0;
+  for (size_t l = 0; l < Lanes; l++) {
+    guard |= lane_mask_t(data[s.i[l] * Lanes + l] !=
+                         0)
+             << l;
+  }
+  return m & guard;
+}
+
+/// Adds Factor times the cell at Source to the cell
+/// at Offset, then clears the source if Clear is
+/// true. The target is only accessed if the loop
+/// would have run, as it can be out of the tape
+/// otherwise.
+template <std::ptrdiff_t Offset, int Factor,
+          std::ptrdiff_t Source, bool Clear,
+          typename State>
+inline void mul_add_lanes(State &s, lane_mask_t m) {
+  constexpr size_t Lanes = State::lanes;
+
+  // Pointers are equal, so the target is in the
+  // tape for every lane or for none
+  if (s.uniform && m == full_mask<Lanes>() &&
+      s.i[0] + Offset < State::tape_size) {
+    char *const row = s.data.data() + s.i[0] * Lanes;
+    char *const source = row + Source * Lanes;
+    char *const target = row + Offset * Lanes;
+    for (size_t l = 0; l < Lanes; l++) {
+      target[l] += Factor * source[l];
+      if constexpr (Clear) {
+        source[l] = 0;
+      }
+    }
+    return;
+  }
+
+  for_lanes(s, m, [](size_t, auto cell) {
+    if (char const source = cell(Source)) {
+      cell(Offset) += Factor * source;
+      if constexpr (Clear) {
+        cell(Source) = 0;
+      }
+    }
+  });
+}
+
+/// Updates the pointers of all the lanes before
+/// they stop being uniform.
+template <typename State>
+inline void diverge(State &s) {
+  if (s.uniform) {
+    s.i.fill(s.i[0]);
+    s.uniform = false;
+  }
+}
+
+/// Returns true if all the pointers are equal.
+template <typename State>
+inline bool same_pointers(State const &s) {
+  return s.uniform ||
+         std::ranges::all_of(s.i, [&](size_t i) {
+           return i == s.i[0];
+         });
+}
+
+/// Moves the pointers of the lanes of a mask.
+template <typename State>
+inline void move_pointers(State &s, lane_mask_t m,
+                          std::ptrdiff_t offset) {
+  constexpr size_t Lanes = State::lanes;
+  if (s.uniform && m == full_mask<Lanes>()) {
+    s.i[0] += offset;
+    return;
+  }
+
+  diverge(s);
+  for (size_t l = 0; l < Lanes; l++) {
+    s.i[l] += is_on(m, l) ? offset : 0;
+  }
+}
+
+/// Runs a scan loop in every lane of a mask.
+template <std::ptrdiff_t Stride, typename State>
+inline void scan_lanes(State &s, lane_mask_t m) {
+  constexpr size_t Lanes = State::lanes;
+  diverge(s);
+  for (size_t l = 0; l < Lanes; l++) {
+    if (is_on(m, l)) {
+      while (s.data[s.i[l] * Lanes + l] != 0) {
+        s.i[l] += Stride;
+      }
+    }
+  }
+  s.uniform = same_pointers(s);
+}
+
+/// Aborts if a lane of a mask accesses a cell out of
+/// its tape.
+template <typename State>
+inline void
+check_lanes(State &s, lane_mask_t m,
+            std::ptrdiff_t min, std::ptrdiff_t max,
+            bool guarded, std::ptrdiff_t guard) {
+  constexpr size_t Lanes = State::lanes;
+  constexpr size_t TapeSize = State::tape_size;
+  for (size_t l = 0; l < Lanes; l++) {
+    size_t const i = s.i[s.uniform ? 0 : l];
+    if (!is_on(m, l) ||
+        (guarded &&
+         s.data[(i + guard) * Lanes + l] == 0)) {
+      continue;
+    }
+    if (i + min >= TapeSize || i + max >= TapeSize)
+        [[unlikely]] {
+      out_of_tape(s, i);
+    }
+  }
+}
+
+} // namespace spmd_impl
+
+/// Generates a program from a fixed_flat_ast_t. The
+/// program takes a lanes state and the mask of the
+/// lanes that run it.
+template <auto const &Ast, size_t InstructionPos = 0>
+constexpr auto codegen() {
+  using namespace spmd_impl;
+  constexpr flat_node_t Instr = Ast[InstructionPos];
+
+  /// Single instruction
+  if constexpr (holds_alternative<flat_token_t>(
+                    Instr)) {
+    constexpr flat_token_t Token =
+        get<flat_token_t>(Instr);
+    constexpr std::ptrdiff_t Offset = Token.offset;
+
+    if constexpr (Token.token == pointer_increase_v) {
+      return [](auto &s, lane_mask_t m) {
+        move_pointers(s, m, 1);
+      };
+    } else if constexpr (Token.token ==
+                         pointer_decrease_v) {
+      return [](auto &s, lane_mask_t m) {
+        move_pointers(s, m, -1);
+      };
+    } else if constexpr (Token.token ==
+                         pointee_increase_v) {
+      return [](auto &s, lane_mask_t m) {
+        for_lanes(s, m, [](size_t, auto cell) {
+          cell(Offset)++;
+        });
+      };
+    } else if constexpr (Token.token ==
+                         pointee_decrease_v) {
+      return [](auto &s, lane_mask_t m) {
+        for_lanes(s, m, [](size_t, auto cell) {
+          cell(Offset)--;
+        });
+      };
+    } else if constexpr (Token.token == put_v) {
+      return [](auto &s, lane_mask_t m) {
+        for_lanes(s, m, [&](size_t l, auto cell) {
+          s.output[l].push_back(cell(Offset));
+        });
+      };
+    } else if constexpr (Token.token == get_v) {
+      // Reading past the end of the input stores
+      // EOF, like std::getchar
+      return [](auto &s, lane_mask_t m) {
+        for_lanes(s, m, [&](size_t l, auto cell) {
+          cell(Offset) =
+              s.input_pos[l] < s.input[l].size()
+                  ? s.input[l][s.input_pos[l]++]
+                  : char(EOF);
+        });
+      };
+    }
+  }
+
+  /// Block of code
+  /// (ie. whole program or while body)
+  else if constexpr (holds_alternative<
+                         flat_block_descriptor_t>(
+                         Instr)) {
+    constexpr flat_block_descriptor_t
+        BlockDescriptor =
+            get<flat_block_descriptor_t>(Instr);
+    return [](auto &s, lane_mask_t m) {
+      static_assert(sizeof(s.data[0]) ==
+                        Ast.cell_size,
+                    "state and AST cell sizes "
+                    "differ");
+      [&]<size_t... InstructionIDs>(
+          std::index_sequence<InstructionIDs...>) {
+        (codegen<Ast, 1 + InstructionPos +
+                          InstructionIDs>()(s, m),
+         ...);
+      }(std::make_index_sequence<
+          BlockDescriptor.size>{});
+    };
+
+  }
+
+  /// While loop, whose body runs in the lanes where
+  /// the guard has never been zero
+  else if constexpr (holds_alternative<flat_while_t>(
+                         Instr)) {
+    constexpr flat_while_t While =
+        get<flat_while_t>(Instr);
+    return [](auto &s, lane_mask_t m) {
+      for (lane_mask_t body = guard_mask(s, m);
+           body != 0; body = guard_mask(s, body)) {
+        codegen<Ast, While.block_begin>()(s, body);
+      }
+      s.uniform = same_pointers(s);
+    };
+  }
+
+  /// Folded cell increment
+  else if constexpr (holds_alternative<flat_add_t>(
+                         Instr)) {
+    constexpr int Value =
+        get<flat_add_t>(Instr).value;
+    constexpr std::ptrdiff_t Offset =
+        get<flat_add_t>(Instr).offset;
+    return [](auto &s, lane_mask_t m) {
+      for_lanes(s, m, [](size_t, auto cell) {
+        cell(Offset) += Value;
+      });
+    };
+  }
+
+  /// Folded pointer move
+  else if constexpr (holds_alternative<flat_move_t>(
+                         Instr)) {
+    constexpr flat_move_t Move =
+        get<flat_move_t>(Instr);
+    return [](auto &s, lane_mask_t m) {
+      move_pointers(s, m, Move.offset);
+    };
+  }
+
+  /// Cell store, ie. a lowered clear loop
+  else if constexpr (holds_alternative<flat_set_t>(
+                         Instr)) {
+    constexpr int Value =
+        get<flat_set_t>(Instr).value;
+    constexpr std::ptrdiff_t Offset =
+        get<flat_set_t>(Instr).offset;
+    return [](auto &s, lane_mask_t m) {
+      for_lanes(s, m, [](size_t, auto cell) {
+        cell(Offset) = Value;
+      });
+    };
+  }
+
+  /// Multiply loop update
+  else if constexpr (
+      holds_alternative<flat_mul_add_t>(Instr)) {
+    constexpr std::ptrdiff_t Offset =
+        get<flat_mul_add_t>(Instr).offset;
+    constexpr int Factor =
+        get<flat_mul_add_t>(Instr).factor;
+    constexpr std::ptrdiff_t Source =
+        get<flat_mul_add_t>(Instr).source;
+    return [](auto &s, lane_mask_t m) {
+      mul_add_lanes<Offset, Factor, Source, false>(
+          s, m);
+    };
+  }
+
+  /// Scan loop
+  else if constexpr (holds_alternative<flat_scan_t>(
+                         Instr)) {
+    constexpr std::ptrdiff_t Stride =
+        get<flat_scan_t>(Instr).stride;
+    return [](auto &s, lane_mask_t m) {
+      scan_lanes<Stride>(s, m);
+    };
+  }
+
+  /// Constant output, written once per run of
+  /// consecutive flat_print_t nodes
+  else if constexpr (holds_alternative<flat_print_t>(
+                         Instr)) {
+    if constexpr (
+        continues_print_run<Ast, InstructionPos>()) {
+      return [](auto &, auto const &) {};
+    } else {
+      return [](auto &s, lane_mask_t m) {
+        constexpr auto const &Run =
+            print_run<Ast, InstructionPos>;
+        for (size_t l = 0; l < s.lanes; l++) {
+          if (spmd_impl::is_on(m, l)) {
+            s.output[l].append(Run.data(),
+                               Run.size());
+          }
+        }
+      };
+    }
+  }
+
+  /// Tape bounds check
+  else if constexpr (holds_alternative<flat_check_t>(
+                         Instr)) {
+    constexpr flat_check_t Check =
+        get<flat_check_t>(Instr);
+    return [](auto &s, lane_mask_t m) {
+      check_lanes(s, m, Check.min, Check.max,
+                  Check.guarded, Check.guard);
+    };
+  }
+
+  /// Superinstruction: cell increment then move
+  else if constexpr (
+      holds_alternative<flat_add_move_t>(Instr)) {
+    constexpr int Value =
+        get<flat_add_move_t>(Instr).value;
+    constexpr std::ptrdiff_t Offset =
+        get<flat_add_move_t>(Instr).offset;
+    constexpr std::ptrdiff_t Move =
+        get<flat_add_move_t>(Instr).move;
+    return [](auto &s, lane_mask_t m) {
+      for_lanes(s, m, [](size_t, auto cell) {
+        cell(Offset) += Value;
+      });
+      move_pointers(s, m, Move);
+    };
+  }
+
+  /// Superinstruction: move then cell store
+  else if constexpr (
+      holds_alternative<flat_move_set_t>(Instr)) {
+    constexpr std::ptrdiff_t Move =
+        get<flat_move_set_t>(Instr).move;
+    constexpr int Value =
+        get<flat_move_set_t>(Instr).value;
+    constexpr std::ptrdiff_t Offset =
+        get<flat_move_set_t>(Instr).offset;
+    return [](auto &s, lane_mask_t m) {
+      move_pointers(s, m, Move);
+      for_lanes(s, m, [](size_t, auto cell) {
+        cell(Offset) = Value;
+      });
+    };
+  }
+
+  /// Superinstruction: multiply loop update then
+  /// source clear
+  else if constexpr (
+      holds_alternative<flat_mul_add_clear_t>(
+          Instr)) {
+    constexpr std::ptrdiff_t Offset =
+        get<flat_mul_add_clear_t>(Instr).offset;
+    constexpr int Factor =
+        get<flat_mul_add_clear_t>(Instr).factor;
+    constexpr std::ptrdiff_t Source =
+        get<flat_mul_add_clear_t>(Instr).source;
+    return [](auto &s, lane_mask_t m) {
+      mul_add_lanes<Offset, Factor, Source, true>(
+          s, m);
+    };
+  }
+
+  /// Superinstruction: move then scan loop
+  else if constexpr (holds_alternative<
+                         flat_move_scan_t>(Instr)) {
+    constexpr std::ptrdiff_t Move =
+        get<flat_move_scan_t>(Instr).move;
+    constexpr std::ptrdiff_t Stride =
+        get<flat_move_scan_t>(Instr).stride;
+    return [](auto &s, lane_mask_t m) {
+      move_pointers(s, m, Move);
+      scan_lanes<Stride>(s, m);
+    };
+  }
+}
+
+/// Runs a fixed_flat_ast_t over input records, Lanes
+/// records at a time, and returns their outputs in
+/// the order of the records. The lanes left over by
+/// the last group run a copy of its last record, so
+/// that every lane stays in lockstep.
+template <auto const &Ast,
+          size_t Lanes = default_lanes,
+          size_t TapeSize = default_tape_size>
+std::vector<std::string>
+run(std::span<std::string_view const> records) {
+  using state_t =
+      basic_lanes_state_t<Lanes, TapeSize>;
+
+  std::vector<std::string> outputs(records.size());
+  auto s = std::make_unique<state_t>();
+
+  for (size_t begin = 0; begin < records.size();
+       begin += Lanes) {
+    size_t const count =
+        std::min(Lanes, records.size() - begin);
+    std::array<std::string_view, Lanes> group;
+    std::ranges::copy(records.subspan(begin, count),
+                      group.begin());
+    std::fill(group.begin() + count, group.end(),
+              group[count - 1]);
+
+    s->reset(group);
+    codegen<Ast>()(*s, full_mask<Lanes>());
+    for (size_t l = 0; l < count; l++) {
+      outputs[begin + l] = std::move(s->output[l]);
+    }
+  }
+  return outputs;
+}
+
+} // namespace brainfuck::flat::spmd
@@ -0,0 +1,274 @@
+#pragma once
+
+// Streaming runner for flat ASTs: programs run as a
+// coroutine that yields their output in chunks, and
+// suspends to ask the caller for input, instead of
+// using the standard streams. Instructions other than
+// I/O run on the function pointer table of the table
+// backend.
+//
+// Usage:
+//
+//   auto stream = flat::stream::run<Ast>(s);
+//   while (stream.next()) {
+//     if (stream.wants_input()) {
+//       stream.provide_input(read_some());
+//     } else {
+//       write(stream.output());
+//     }
+//   }
+
+#include <array>
+#include <coroutine>
+#include <cstdio>
+#include <exception>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include <brainfuck/backends/flat/linear-program.hpp>
+#include <brainfuck/backends/flat/table-codegen.hpp>
+
+namespace brainfuck::flat::stream {
+
+/// Default number of characters per output chunk
+inline constexpr size_t default_chunk_size = 4096;
+
+/// Running program, see run.
+class stream_t {
+public:
+  struct promise_type;
+  using handle_t =
+      std::coroutine_handle<promise_type>;
+
+  /// Awaited by the program to ask for input, see
+  /// provide_input.
+  struct input_request_t {};
+
+  /// Suspends the program until the caller provides
+  /// input.
+  struct input_awaiter_t {
+    promise_type &promise;
+
+    bool await_ready() const noexcept {
+      return false;
+    }
+    void await_suspend(handle_t) const noexcept {}
+    std::span<char const> await_resume() const {
+      return promise.input;
+    }
+  };
+
+  struct promise_type {
+    std::span<char const> output;
+    std::span<char const> input;
+    bool wants_input = false;
+    std::exception_ptr exception;
+
+    stream_t get_return_object() {
+      return stream_t(handle_t::from_promise(*this));
+    }
+
+    std::suspend_always initial_suspend() noexcept {
+      return {};
+    }
+    std::suspend_always final_suspend() noexcept {
+      return {};
+    }
+
+    std::suspend_always
+    yield_value(std::span<char const> chunk) {
+      output = chunk;
+      wants_input = false;
+      return {};
+    }
+
+    input_awaiter_t await_transform(input_request_t) {
+      wants_input = true;
+      input = {};
+      return {*this};
+    }
+
+    void return_void() {}
+    void unhandled_exception() {
+      exception = std::current_exception();
+    }
+  };
+
+  stream_t(stream_t &&other)
+      : handle_(std::exchange(other.handle_, {})) {}
+  stream_t &operator=(stream_t other) {
+    std::swap(handle_, other.handle_);
+    return *this;
+  }
+  ~stream_t() {
+    if (handle_) {
+      handle_.destroy();
+    }
+  }
+
+  /// Runs the program until it outputs a chunk,
+  /// needs input, or ends. Returns false if it has
+  /// ended.
+  bool next() {
+    if (handle_.done()) {
+      return false;
+    }
+    handle_.resume();
+    if (handle_.promise().exception) {
+      std::rethrow_exception(
+          handle_.promise().exception);
+    }
+    return !handle_.done();
+  }
+
+  /// Returns true if the program waits for input
+  /// rather than for its output to be consumed.
+  bool wants_input() const {
+    return handle_.promise().wants_input;
+  }
+
+  /// Returns the last output chunk, which is valid
+  /// until the next call to next.
+  std::span<char const> output() const {
+    return handle_.promise().output;
+  }
+
+  /// Provides the input requested by the program. It
+  /// must stay valid until the program asks for more,
+  /// and an empty chunk marks the end of the input.
+  void provide_input(std::span<char const> chunk) {
+    handle_.promise().input = chunk;
+  }
+
+private:
+  explicit stream_t(handle_t handle)
+      : handle_(handle) {}
+
+  handle_t handle_;
+};
+
+namespace stream_impl {
+
+/// Returns the handler of an instruction, or nullptr
+/// for I/O instructions which are run by the
+/// coroutine itself.
+template <typename State, auto const &Program,
+          size_t Pos>
+constexpr auto handler() -> bool (*)(State &) {
+  constexpr flat_node_t const &Node =
+      Program.code[Pos].node;
+
+  if constexpr (holds_alternative<flat_print_t>(
+                    Node)) {
+    return nullptr;
+  } else if constexpr (holds_alternative<
+                           flat_token_t>(Node)) {
+    constexpr token_t Token =
+        get<flat_token_t>(Node).token;
+    if constexpr (Token == put_v || Token == get_v) {
+      return nullptr;
+    } else {
+      return table::table_impl::handler<
+          State, Program, Pos>();
+    }
+  } else {
+    return table::table_impl::handler<State, Program,
+                                      Pos>();
+  }
+}
+
+/// Dispatch table of a linearized program.
+template <typename State, auto const &Program>
+inline constexpr auto dispatch_table =
+    []<size_t... Pos>(std::index_sequence<Pos...>) {
+      return std::array<table::table_impl::entry_t<
+                            State>,
+                        sizeof...(Pos)>{
+          table::table_impl::entry_t<State>{
+              handler<State, Program, Pos>(),
+              Program.code[Pos].jump}...};
+    }(std::make_index_sequence<
+        Program.code.size()>{});
+
+} // namespace stream_impl
+
+/// Runs a fixed_flat_ast_t as a coroutine. Output is
+/// yielded in chunks of chunk_size characters, and
+/// pending output is yielded before asking for input.
+/// Reading past the end of the input stores EOF, like
+/// the other backends. The state must outlive the
+/// returned stream.
+template <auto const &Ast, typename State>
+stream_t run(State &s,
+             size_t chunk_size = default_chunk_size) {
+  static_assert(sizeof(s.data[0]) == Ast.cell_size,
+                "state and AST cell sizes differ");
+  constexpr auto const &Program =
+      linear::linearized<Ast>;
+  constexpr auto const &Table =
+      stream_impl::dispatch_table<State, Program>;
+
+  std::vector<char> output;
+  output.reserve(chunk_size);
+  std::span<char const> input;
+  size_t input_pos = 0;
+  bool end_of_input = false;
+
+  for (size_t pc = 0; pc < Table.size();) {
+    if (Table[pc].handler != nullptr) {
+      pc = Table[pc].handler(s) ? Table[pc].jump
+                                : pc + 1;
+      continue;
+    }
+
+    linear::instruction_t const &instr =
+        Program.code[pc++];
+
+    // Constant output
+    if (holds_alternative<flat_print_t>(instr.node)) {
+      for (size_t k = 0; k < instr.text_size; k++) {
+        output.push_back(
+            Program.text[instr.text_begin + k]);
+        if (output.size() >= chunk_size) {
+          co_yield output;
+          output.clear();
+        }
+      }
+      continue;
+    }
+
+    flat_token_t const &token =
+        get<flat_token_t>(instr.node);
+    auto &cell = s.data[s.i + token.offset];
+
+    if (token.token == put_v) {
+      output.push_back(cell);
+      if (output.size() >= chunk_size) {
+        co_yield output;
+        output.clear();
+      }
+    } else {
+      if (input_pos == input.size() &&
+          !end_of_input) {
+        if (!output.empty()) {
+          co_yield output;
+          output.clear();
+        }
+        input = co_await stream_t::input_request_t{};
+        input_pos = 0;
+        end_of_input = input.empty();
+      }
+      cell = input_pos < input.size()
+                 ? static_cast<unsigned char>(
+                       input[input_pos++])
+                 : EOF;
+    }
+  }
+
+  if (!output.empty()) {
+    co_yield output;
+  }
+}
+
+} // namespace brainfuck::flat::stream
@@ -0,0 +1,111 @@
+#pragma once
+
+// Flat backend that runs linearized programs
+// through a static table of handler function
+// pointers. Handlers are templates on the node they
+// run, so they are instantiated once per distinct
+// node value instead of once per position, and their
+// instantiation depth does not depend on loop
+// nesting.
+
+#include <array>
+#include <cstdio>
+#include <type_traits>
+#include <utility>
+
+#include <brainfuck/backends/flat/linear-program.hpp>
+
+namespace brainfuck::flat::table {
+
+namespace table_impl {
+
+/// Runs a node, which never jumps.
+template <typename State, auto Node>
+bool run_node(State &s) {
+  linear::run_node<State, Node>(s);
+  return false;
+}
+
+/// Writes a slice of the constant output of a
+/// program.
+template <typename State, auto const &Text,
+          size_t Begin, size_t Size>
+bool run_print(State &s) {
+  output_text(s, Text.data() + Begin, Size);
+  return false;
+}
+
+template <typename State>
+bool run_jump_if_zero(State &s) {
+  return s.data[s.i] == 0;
+}
+
+template <typename State>
+bool run_jump_if_not_zero(State &s) {
+  return s.data[s.i] != 0;
+}
+
+/// Dispatch table entry
+template <typename State> struct entry_t {
+  bool (*handler)(State &);
+  size_t jump;
+};
+
+/// Returns the handler of an instruction.
+template <typename State, auto const &Program,
+          size_t Pos>
+constexpr auto handler() -> bool (*)(State &) {
+  constexpr linear::instruction_t const &Instr =
+      Program.code[Pos];
+  constexpr flat_node_t const &Node = Instr.node;
+
+  if constexpr (Instr.kind ==
+                linear::jump_if_zero_v) {
+    return &run_jump_if_zero<State>;
+  } else if constexpr (Instr.kind ==
+                       linear::jump_if_not_zero_v) {
+    return &run_jump_if_not_zero<State>;
+  } else if constexpr (holds_alternative<
+                           flat_print_t>(Node)) {
+    return &run_print<State, Program.text,
+                      Instr.text_begin,
+                      Instr.text_size>;
+  } else {
+    return &run_node<State, get<Node.index()>(Node)>;
+  }
+}
+
+/// Dispatch table of a linearized program.
+template <typename State, auto const &Program>
+inline constexpr auto dispatch_table =
+    []<size_t... Pos>(std::index_sequence<Pos...>) {
+      return std::array<entry_t<State>,
+                        sizeof...(Pos)>{
+          entry_t<State>{
+              handler<State, Program, Pos>(),
+              Program.code[Pos].jump}...};
+    }(std::make_index_sequence<
+        Program.code.size()>{});
+
+} // namespace table_impl
+
+/// Generates a program from a fixed_flat_ast_t
+template <auto const &Ast>
+constexpr auto codegen() {
+  return [](auto &s) {
+    static_assert(sizeof(s.data[0]) == Ast.cell_size,
+                  "state and AST cell sizes differ");
+    using state_t =
+        std::remove_reference_t<decltype(s)>;
+    constexpr auto const &Table =
+        table_impl::dispatch_table<
+            state_t, linear::linearized<Ast>>;
+
+    for (size_t pc = 0; pc < Table.size();) {
+      pc = Table[pc].handler(s) ? Table[pc].jump
+                                : pc + 1;
+    }
+  };
+}
+
+} // namespace brainfuck::flat::table
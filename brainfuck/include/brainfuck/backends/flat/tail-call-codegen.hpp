@@ -0,0 +1,87 @@
+#pragma once
+
+// Flat backend where each instruction of a
+// linearized program is a function that runs its
+// node, then tail calls the function of the next
+// instruction. Loops are conditional tail calls to
+// their entry or exit, so programs run without
+// growing the stack and without an indirect jump per
+// instruction.
+
+#include <cstdio>
+#include <type_traits>
+
+#include <brainfuck/backends/flat/linear-program.hpp>
+
+// Tail calls are guaranteed with Clang. Other
+// compilers rely on sibling call optimization, which
+// requires optimizations to be turned on.
+#if defined(__has_cpp_attribute)
+#if __has_cpp_attribute(clang::musttail)
+#define BRAINFUCK_MUSTTAIL [[clang::musttail]]
+#endif
+#endif
+
+#ifndef BRAINFUCK_MUSTTAIL
+#define BRAINFUCK_MUSTTAIL
+#endif
+
+namespace brainfuck::flat::tail_call {
+
+namespace tail_call_impl {
+
+/// Runs the instruction at position Pos of a
+/// linearized program, then the rest of the program.
+template <typename State, auto const &Program,
+          size_t Pos>
+void run(State &s) {
+  if constexpr (Pos == Program.code.size()) {
+    return;
+  } else {
+    constexpr linear::instruction_t const &Instr =
+        Program.code[Pos];
+    constexpr flat_node_t const &Node = Instr.node;
+
+    if constexpr (Instr.kind ==
+                  linear::jump_if_zero_v) {
+      if (s.data[s.i] == 0) {
+        BRAINFUCK_MUSTTAIL return run<
+            State, Program, Instr.jump>(s);
+      }
+    } else if constexpr (Instr.kind ==
+                         linear::jump_if_not_zero_v) {
+      if (s.data[s.i] != 0) {
+        BRAINFUCK_MUSTTAIL return run<
+            State, Program, Instr.jump>(s);
+      }
+    } else if constexpr (holds_alternative<
+                             flat_print_t>(Node)) {
+      output_text(
+          s, Program.text.data() + Instr.text_begin,
+          Instr.text_size);
+    } else {
+      linear::run_node<State,
+                       get<Node.index()>(Node)>(s);
+    }
+
+    BRAINFUCK_MUSTTAIL return run<State, Program,
+                                  Pos + 1>(s);
+  }
+}
+
+} // namespace tail_call_impl
+
+/// Generates a program from a fixed_flat_ast_t
+template <auto const &Ast>
+constexpr auto codegen() {
+  return [](auto &s) {
+    static_assert(sizeof(s.data[0]) == Ast.cell_size,
+                  "state and AST cell sizes differ");
+    using state_t =
+        std::remove_reference_t<decltype(s)>;
+    tail_call_impl::run<
+        state_t, linear::linearized<Ast>, 0>(s);
+  };
+}
+
+} // namespace brainfuck::flat::tail_call
@@ -0,0 +1,412 @@
+#pragma once
+
+// Static analysis of the tape cells accessed by a
+// flat AST. Pointer positions are tracked exactly
+// from the beginning of the program, through moves
+// and loops whose body leaves the pointer where it
+// was. They are lost after scans and unbalanced
+// loops, in which case accesses are split into
+// segments that can be checked at runtime.
+
+#include <algorithm>
+#include <limits>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include <brainfuck/backends/flat/ast.hpp>
+#include <brainfuck/program.hpp>
+
+namespace brainfuck::flat {
+
+/// Result of a tape bounds analysis.
+struct tape_bounds_t {
+  /// Lowest and highest cell positions accessed at a
+  /// statically known position, relative to the
+  /// initial pointer position
+  std::ptrdiff_t min = 0;
+  std::ptrdiff_t max = 0;
+
+  /// True if every access is at a statically known
+  /// position
+  bool proven = true;
+
+  /// Returns the size of the smallest tape that fits
+  /// every access, or 0 if there is none.
+  constexpr size_t tape_size() const {
+    if (!proven || min < 0) {
+      return 0;
+    }
+    return size_t(max) + 1;
+  }
+};
+
+namespace tape_bounds_impl {
+
+/// Returns the pointer move of a block, or nothing
+/// if it is not a constant.
+constexpr std::optional<std::ptrdiff_t>
+net_move(flat_blocks_t const &blocks,
+         size_t block_id) {
+  std::ptrdiff_t move = 0;
+
+  for (flat_node_t const &node : blocks[block_id]) {
+    if (holds_alternative<flat_move_t>(node)) {
+      move += get<flat_move_t>(node).offset;
+    } else if (holds_alternative<flat_token_t>(
+                   node)) {
+      token_t const token =
+          get<flat_token_t>(node).token;
+      if (token == pointer_increase_v) {
+        move++;
+      } else if (token == pointer_decrease_v) {
+        move--;
+      }
+    } else if (holds_alternative<flat_while_t>(
+                   node)) {
+      size_t const body =
+          get<flat_while_t>(node).block_begin;
+      if (net_move(blocks, body) != 0) {
+        return std::nullopt;
+      }
+    } else if (holds_alternative<flat_add_move_t>(
+                   node)) {
+      move += get<flat_add_move_t>(node).move;
+    } else if (holds_alternative<flat_move_set_t>(
+                   node)) {
+      move += get<flat_move_set_t>(node).move;
+    } else if (holds_alternative<flat_scan_t>(node) ||
+               holds_alternative<flat_move_scan_t>(
+                   node)) {
+      return std::nullopt;
+    }
+  }
+
+  return move;
+}
+
+/// Range of offsets relative to the pointer.
+struct range_t {
+  std::ptrdiff_t min;
+  std::ptrdiff_t max;
+
+  constexpr void extend(std::ptrdiff_t offset) {
+    min = std::min(min, offset);
+    max = std::max(max, offset);
+  }
+
+  constexpr bool contains(range_t const &r) const {
+    return min <= r.min && r.max <= max;
+  }
+
+  constexpr void extend(range_t const &r) {
+    extend(r.min);
+    extend(r.max);
+  }
+};
+
+/// Cells updated by a run of flat_mul_add_t nodes
+/// with the same source. They are only accessed by
+/// the original program if the source cell is not
+/// zero.
+struct guarded_range_t {
+  /// Positions of the first and last nodes of the run
+  size_t begin;
+  size_t end;
+
+  std::ptrdiff_t guard;
+  range_t range;
+};
+
+/// Tape accesses of a segment, ie. a sequence of
+/// nodes that do not move the pointer, and that ends
+/// at the first I/O node.
+struct segment_t {
+  /// Position of the first node of the segment
+  size_t begin = 0;
+
+  std::optional<range_t> range;
+  std::vector<guarded_range_t> guarded;
+
+  constexpr void access(std::ptrdiff_t offset) {
+    if (range) {
+      range->extend(offset);
+    } else {
+      range = range_t{offset, offset};
+    }
+  }
+
+  constexpr void
+  guarded_access(size_t pos, std::ptrdiff_t guard,
+                 std::ptrdiff_t offset) {
+    // Extending the current run if the previous node
+    // belongs to it
+    if (!guarded.empty() &&
+        guarded.back().guard == guard &&
+        guarded.back().end + 1 == pos) {
+      guarded.back().range.extend(offset);
+      guarded.back().end = pos;
+      return;
+    }
+    guarded.push_back(
+        {pos, pos, guard, {offset, offset}});
+  }
+};
+
+/// Check to insert before the node at a given
+/// position of a block.
+struct check_insertion_t {
+  size_t pos;
+  flat_check_t check;
+};
+
+/// Walks through the blocks of a flat AST, tracking
+/// the pointer position and listing the checks needed
+/// for the accesses that are not proven to be in the
+/// tape.
+struct walker_t {
+  flat_blocks_t const &blocks;
+  size_t tape_size;
+
+  tape_bounds_t bounds = {};
+
+  /// Checks to insert in each block, by position
+  std::vector<std::vector<check_insertion_t>> checks =
+      std::vector<std::vector<check_insertion_t>>(
+          blocks.size());
+
+  /// Returns true if a range is proven to be in the
+  /// tape, and updates the bounds.
+  constexpr bool
+  proven(range_t const &range,
+         std::optional<std::ptrdiff_t> position) {
+    if (!position) {
+      bounds.proven = false;
+      return false;
+    }
+
+    std::ptrdiff_t const min = *position + range.min;
+    std::ptrdiff_t const max = *position + range.max;
+    bounds.min = std::min(bounds.min, min);
+    bounds.max = std::max(bounds.max, max);
+    return min >= 0 &&
+           max < std::ptrdiff_t(tape_size);
+  }
+
+  /// Closes a segment. The window holds the offsets
+  /// that are known to be in the tape thanks to
+  /// previous checks, and is updated by new checks.
+  constexpr void
+  close(size_t block_id, segment_t &segment,
+        std::optional<std::ptrdiff_t> position,
+        std::optional<range_t> &window) {
+    std::vector<check_insertion_t> &block_checks =
+        checks[block_id];
+
+    if (segment.range &&
+        !proven(*segment.range, position)) {
+      if (!window ||
+          !window->contains(*segment.range)) {
+        block_checks.push_back(
+            {segment.begin, flat_check_t{
+                                segment.range->min,
+                                segment.range->max}});
+      }
+
+      // The tape is contiguous, so the cells in
+      // between are in the tape too
+      if (window) {
+        window->extend(*segment.range);
+      } else {
+        window = segment.range;
+      }
+    }
+
+    // The guard is in the segment range, so it is
+    // safe to read by the time the guarded check runs
+    for (guarded_range_t const &run :
+         segment.guarded) {
+      if ((segment.range &&
+           segment.range->contains(run.range)) ||
+          (window && window->contains(run.range))) {
+        continue;
+      }
+      if (!proven(run.range, position)) {
+        block_checks.push_back(
+            {run.begin,
+             flat_check_t{run.range.min,
+                          run.range.max, true,
+                          run.guard}});
+      }
+    }
+
+    segment = {};
+  }
+
+  /// Walks through a block, starting at the given
+  /// position if it is known, and with the given
+  /// window of checked offsets.
+  constexpr void
+  walk(size_t block_id,
+       std::optional<std::ptrdiff_t> position,
+       std::optional<range_t> window = std::nullopt) {
+    flat_ast_t const &block = blocks[block_id];
+    segment_t segment;
+
+    // Starts a new segment after a pointer move
+    auto move =
+        [&](size_t pos,
+            std::optional<std::ptrdiff_t> offset) {
+          close(block_id, segment, position, window);
+          if (offset) {
+            if (position) {
+              *position += *offset;
+            }
+            if (window) {
+              window->min -= *offset;
+              window->max -= *offset;
+            }
+          } else {
+            position = std::nullopt;
+            window = std::nullopt;
+          }
+          segment.begin = pos + 1;
+        };
+
+    // Starts a new segment after I/O or a loop, so
+    // that the checks of later accesses do not run
+    // before an observable side effect
+    auto observe = [&](size_t pos) {
+      close(block_id, segment, position, window);
+      segment.begin = pos + 1;
+    };
+
+    for (size_t pos = 0; pos < block.size(); pos++) {
+      flat_node_t const &node = block[pos];
+
+      if (holds_alternative<flat_move_t>(node)) {
+        move(pos, get<flat_move_t>(node).offset);
+      }
+
+      else if (holds_alternative<flat_token_t>(
+                   node)) {
+        flat_token_t const &token =
+            get<flat_token_t>(node);
+        if (token.token == pointer_increase_v) {
+          move(pos, 1);
+        } else if (token.token ==
+                   pointer_decrease_v) {
+          move(pos, -1);
+        } else {
+          segment.access(token.offset);
+          if (token.token == put_v ||
+              token.token == get_v) {
+            observe(pos);
+          }
+        }
+      }
+
+      else if (holds_alternative<flat_print_t>(
+                   node)) {
+        observe(pos);
+      }
+
+      else if (holds_alternative<flat_add_t>(node)) {
+        segment.access(get<flat_add_t>(node).offset);
+      }
+
+      else if (holds_alternative<flat_set_t>(node)) {
+        segment.access(get<flat_set_t>(node).offset);
+      }
+
+      else if (holds_alternative<flat_mul_add_t>(
+                   node)) {
+        flat_mul_add_t const &mul_add =
+            get<flat_mul_add_t>(node);
+        segment.access(mul_add.source);
+        segment.guarded_access(pos, mul_add.source,
+                               mul_add.offset);
+      }
+
+      else if (holds_alternative<flat_scan_t>(node)) {
+        segment.access(0);
+        move(pos, std::nullopt);
+      }
+
+      else if (holds_alternative<flat_while_t>(
+                   node)) {
+        size_t const body =
+            get<flat_while_t>(node).block_begin;
+        segment.access(0);
+        if (net_move(blocks, body) == 0) {
+          // Later accesses are checked after the loop,
+          // which may not terminate or may do I/O
+          observe(pos);
+          walk(body, position, window);
+        } else {
+          move(pos, std::nullopt);
+          walk(body, std::nullopt);
+        }
+      }
+
+      // Superinstructions, which only need to be
+      // supported by the analysis since the bounds
+      // check pass runs before they are formed
+
+      else if (holds_alternative<flat_add_move_t>(
+                   node)) {
+        flat_add_move_t const &add_move =
+            get<flat_add_move_t>(node);
+        segment.access(add_move.offset);
+        move(pos, add_move.move);
+      }
+
+      else if (holds_alternative<flat_move_set_t>(
+                   node)) {
+        flat_move_set_t const &move_set =
+            get<flat_move_set_t>(node);
+        move(pos, move_set.move);
+        segment.access(move_set.offset);
+      }
+
+      else if (holds_alternative<
+                   flat_mul_add_clear_t>(node)) {
+        flat_mul_add_clear_t const &mul_add =
+            get<flat_mul_add_clear_t>(node);
+        segment.access(mul_add.source);
+        segment.guarded_access(pos, mul_add.source,
+                               mul_add.offset);
+      }
+
+      else if (holds_alternative<flat_move_scan_t>(
+                   node)) {
+        move(pos, get<flat_move_scan_t>(node).move);
+        segment.access(0);
+        move(pos, std::nullopt);
+      }
+    }
+
+    // Loop guards are read again at the end of loop
+    // bodies
+    if (block_id != 0) {
+      segment.access(0);
+    }
+    close(block_id, segment, position, window);
+  }
+};
+
+} // namespace tape_bounds_impl
+
+/// Computes the range of cells accessed by a program,
+/// see tape_bounds_t. Expects propagate_constants
+/// output.
+constexpr tape_bounds_t
+analyze_tape_bounds(flat_ast_t const &ast) {
+  flat_blocks_t const blocks = split_blocks(ast);
+  tape_bounds_impl::walker_t walker{
+      blocks, std::numeric_limits<size_t>::max() / 2};
+  walker.walk(0, 0);
+  return walker.bounds;
+}
+
+} // namespace brainfuck::flat
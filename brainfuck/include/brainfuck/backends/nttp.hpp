@@ -8,11 +8,11 @@
 
 namespace brainfuck::backends::nttp {
 
-template <ast_node_t const &n>
-void run_node(program_state_t &);
+template <ast_node_t const &n, typename State>
+void run_node(State &);
 
-template <ast_token_t const &n>
-void run_token(program_state_t &s) {
+template <ast_token_t const &n, typename State>
+void run_token(State &s) {
   if constexpr (n.get_token() == fwd_v)
     s.i++;
   if constexpr (n.get_token() == bwd_v)
@@ -22,13 +22,13 @@ void run_token(program_state_t &s) {
   if constexpr (n.get_token() == dec_v)
     s.data[s.i]--;
   if constexpr (n.get_token() == put_v)
-    std::putchar(s.data[s.i]);
+    output_char(s, s.data[s.i]);
   if constexpr (n.get_token() == get_v)
-    s.data[s.i] = std::getchar();
+    s.data[s.i] = input_char(s);
 }
 
-template <ast_block_t const &n>
-void run_block(program_state_t &s) {
+template <ast_block_t const &n, typename State>
+void run_block(State &s) {
   constexpr auto N = n.get_content().size();
   [&s]<std::size_t... Is>(
       std::index_sequence<Is...>) {
@@ -36,15 +36,15 @@ void run_block(program_state_t &s) {
   }(std::make_index_sequence<N>{});
 }
 
-template <ast_while_t const &n>
-void run_while(program_state_t &s) {
+template <ast_while_t const &n, typename State>
+void run_while(State &s) {
   while (s.data[s.i]) {
     run_block<&(n.get_block())>(s);
   }
 }
 
-template <ast_node_ptr_t const &p>
-void run_node_ptr(program_state_t &s) {
+template <ast_node_ptr_t const &p, typename State>
+void run_node_ptr(State &s) {
   if constexpr (p->get_kind() == ast_token_v)
     run_token<getas<ast_token_t>(p)>(s);
   if constexpr (p->get_kind() == ast_block_v)
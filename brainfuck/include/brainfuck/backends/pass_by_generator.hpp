@@ -36,7 +36,7 @@ constexpr auto vector_codegen() {
 
   // Performing a static unrolling
   // on the vector's elements
-  return [&](program_state_t &state) {
+  return [&](auto &state) {
     [&]<std::size_t... IndexPack>(
         std::index_sequence<IndexPack...>) {
       (...,
@@ -55,37 +55,37 @@ constexpr auto vector_codegen() {
 /// as a token to instruction map
 template <token_t Token>
 inline constexpr auto instruction_from_token =
-    [](program_state_t &) {};
+    [](auto &) {};
 
 template <>
 inline constexpr auto
     instruction_from_token<pointer_increase_v> =
-        [](program_state_t &state) { state.i++; };
+        [](auto &state) { state.i++; };
 template <>
 inline constexpr auto
     instruction_from_token<pointer_decrease_v> =
-        [](program_state_t &state) { state.i--; };
+        [](auto &state) { state.i--; };
 template <>
 inline constexpr auto
     instruction_from_token<pointee_increase_v> =
-        [](program_state_t &state) {
+        [](auto &state) {
           state.data[state.i]++;
         };
 template <>
 inline constexpr auto
     instruction_from_token<pointee_decrease_v> =
-        [](program_state_t &state) {
+        [](auto &state) {
           state.data[state.i]--;
         };
 template <>
 inline constexpr auto instruction_from_token<put_v> =
-    [](program_state_t &state) {
-      std::putchar(state.data[state.i]);
+    [](auto &state) {
+      output_char(state, state.data[state.i]);
     };
 template <>
 inline constexpr auto instruction_from_token<get_v> =
-    [](program_state_t &state) {
-      state.data[state.i] = std::getchar();
+    [](auto &state) {
+      state.data[state.i] = input_char(state);
     };
 } // namespace detail
 
@@ -126,7 +126,7 @@ constexpr auto codegen() {
         }>();
 
     // Encapsulating it inside a while loop
-    return [while_body](program_state_t &state) {
+    return [while_body](auto &state) {
       while (state.data[state.i]) {
         while_body(state);
       }
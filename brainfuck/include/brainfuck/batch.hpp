@@ -0,0 +1,131 @@
+#pragma once
+
+// Batch runner: runs the same program over many
+// independent input records on a pool of threads.
+// Each thread owns a tape that is reset between
+// records, and the I/O of each record goes to memory
+// buffers instead of the standard streams.
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdio>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <brainfuck/program.hpp>
+
+namespace brainfuck::batch {
+
+/// Number of records claimed at once by a thread
+inline constexpr std::size_t default_grain_size = 64;
+
+/// Program state whose input and output are memory
+/// buffers, see output_char and input_char.
+template <std::size_t TapeSize = default_tape_size,
+          typename Cell = char,
+          typename Storage = inline_storage_t>
+struct basic_record_state_t
+    : basic_program_state_t<TapeSize, Cell, Storage> {
+  std::string_view input;
+  std::size_t input_pos = 0;
+  std::string output;
+
+  void put(char c) { output.push_back(c); }
+
+  void write(char const *text, std::size_t size) {
+    output.append(text, size);
+  }
+
+  /// Reading past the end of the input returns EOF,
+  /// like std::getchar
+  int get() {
+    return input_pos < input.size()
+               ? static_cast<unsigned char>(
+                     input[input_pos++])
+               : EOF;
+  }
+
+  /// Clears the tape and the output, and sets the
+  /// input for the next record. Tapes that provide a
+  /// clear member function are cleared with it.
+  void reset(std::string_view record) {
+    if constexpr (requires { this->data.clear(); }) {
+      this->data.clear();
+    } else {
+      std::ranges::fill(this->data, 0);
+    }
+    this->i = 0;
+    input = record;
+    input_pos = 0;
+    output.clear();
+  }
+};
+
+using record_state_t = basic_record_state_t<>;
+
+/// Returns the number of hardware threads, or 1 if
+/// it is unknown.
+inline std::size_t default_thread_count() {
+  unsigned const count =
+      std::thread::hardware_concurrency();
+  return count == 0 ? 1 : count;
+}
+
+/// Runs a program over input records, and returns
+/// their outputs in the order of the records. The
+/// program is called as program(s) with a State,
+/// like the programs generated by the flat backends.
+/// Records are claimed by threads in blocks of
+/// grain_size, so that threads stay busy when records
+/// take different times. Counts of 0 are taken as 1.
+template <typename State = record_state_t,
+          typename Program>
+std::vector<std::string>
+run_batch(Program const &program,
+          std::span<std::string_view const> records,
+          std::size_t thread_count =
+              default_thread_count(),
+          std::size_t grain_size =
+              default_grain_size) {
+  grain_size = std::max<std::size_t>(grain_size, 1);
+
+  std::vector<std::string> outputs(records.size());
+  std::atomic<std::size_t> next_record = 0;
+
+  auto const work = [&]() {
+    auto s = std::make_unique<State>();
+    for (;;) {
+      std::size_t const begin =
+          next_record.fetch_add(grain_size);
+      if (begin >= records.size()) {
+        return;
+      }
+      std::size_t const end = std::min(
+          begin + grain_size, records.size());
+
+      for (std::size_t k = begin; k < end; k++) {
+        s->reset(records[k]);
+        program(*s);
+        outputs[k] = s->output;
+      }
+    }
+  };
+
+  {
+    std::vector<std::jthread> threads;
+    threads.reserve(thread_count);
+    for (std::size_t k = 0;
+         k < std::max<std::size_t>(thread_count, 1);
+         k++) {
+      threads.emplace_back(work);
+    }
+  }
+  return outputs;
+}
+
+} // namespace brainfuck::batch
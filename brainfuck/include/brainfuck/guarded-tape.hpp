@@ -0,0 +1,329 @@
+#pragma once
+
+// Growable tape storage backed by virtual memory. A
+// tape reserves its whole address range up front,
+// between two guard regions, and commits pages as
+// the program reaches them. Faults on reserved pages
+// are turned into growth by a SIGSEGV handler, and
+// faults on guard regions into a clean error, so
+// programs can run without bounds checks and cells
+// that are never touched cost no memory.
+
+#if defined(__unix__)
+
+/// Defined if guarded tapes are supported
+#define BRAINFUCK_HAS_GUARDED_TAPE
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <utility>
+
+#include <signal.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <brainfuck/program.hpp>
+
+namespace brainfuck {
+
+/// Default size of guarded tapes, in cells. It only
+/// costs address space until cells are reached.
+inline constexpr std::size_t guarded_tape_size =
+    std::size_t(1) << 32;
+
+namespace guarded_tape_impl {
+
+/// Bytes committed when a tape is created, and
+/// granularity of its growth. It is a multiple of
+/// the page size on all supported targets.
+inline constexpr std::size_t commit_granularity =
+    std::size_t(1) << 16;
+
+/// Size of each guard region, right before the first
+/// cell and right after the page of the last one. It
+/// spans many pages so that accesses at an offset
+/// from a pointer that left the tape still hit it.
+inline constexpr std::size_t guard_size =
+    std::size_t(1) << 20;
+
+/// Maximum number of live guarded tapes
+inline constexpr std::size_t max_tapes = 1024;
+
+/// Address range of a live tape, as seen by the
+/// signal handler.
+struct region_t {
+  /// First cell, or 0 if the region is free
+  std::atomic<std::uintptr_t> begin = 0;
+
+  /// End of the committed cells
+  std::atomic<std::uintptr_t> committed = 0;
+
+  /// End of the reserved cells
+  std::atomic<std::uintptr_t> end = 0;
+};
+
+inline std::array<region_t, max_tapes> regions;
+
+/// Handler that was installed before ours
+inline struct sigaction previous_action;
+
+constexpr std::uintptr_t
+round_up(std::uintptr_t address) {
+  return (address + commit_granularity - 1) &
+         ~std::uintptr_t(commit_granularity - 1);
+}
+
+/// Passes a fault that does not belong to a tape to
+/// the previous handler.
+inline void forward_fault(int signal_number,
+                          siginfo_t *info,
+                          void *context) {
+  if (previous_action.sa_flags & SA_SIGINFO) {
+    previous_action.sa_sigaction(signal_number, info,
+                                 context);
+  } else if (previous_action.sa_handler == SIG_DFL ||
+             previous_action.sa_handler == SIG_IGN) {
+    // The faulting instruction runs again once the
+    // handler returns, and kills the process
+    ::signal(signal_number, SIG_DFL);
+  } else {
+    previous_action.sa_handler(signal_number);
+  }
+}
+
+inline void handle_fault(int signal_number,
+                         siginfo_t *info,
+                         void *context) {
+  auto const address =
+      reinterpret_cast<std::uintptr_t>(info->si_addr);
+
+  for (region_t &region : regions) {
+    std::uintptr_t const begin =
+        region.begin.load(std::memory_order_acquire);
+    std::uintptr_t const end =
+        region.end.load(std::memory_order_relaxed);
+    if (begin == 0 ||
+        address < begin - guard_size ||
+        address >= end + guard_size) {
+      continue;
+    }
+
+    // Commits the faulting page, and at least doubles
+    // the committed cells to keep faults rare
+    std::uintptr_t const committed =
+        region.committed.load(
+            std::memory_order_relaxed);
+    if (address >= committed && address < end) {
+      std::uintptr_t const target = std::min(
+          end,
+          std::max(round_up(address + 1),
+                   committed + (committed - begin)));
+      if (mprotect(
+              reinterpret_cast<void *>(committed),
+              target - committed,
+              PROT_READ | PROT_WRITE) == 0) {
+        region.committed.store(
+            target, std::memory_order_relaxed);
+        return;
+      }
+    }
+
+    // The faulting access was made by the program,
+    // not by stdio, so pending output can be written
+    // like in out_of_tape
+    buffered_io_t::flush_all();
+    std::fflush(stdout);
+
+    static constexpr char message[] =
+        "brainfuck: tape access out of bounds "
+        "(guard page hit)\n";
+    ::write(STDERR_FILENO, message,
+            sizeof(message) - 1);
+    std::abort();
+  }
+
+  forward_fault(signal_number, info, context);
+}
+
+/// Installs the SIGSEGV handler once per process.
+inline void install_handler() {
+  static bool const installed = [] {
+    struct sigaction action = {};
+    action.sa_sigaction = handle_fault;
+    action.sa_flags = SA_SIGINFO;
+    sigemptyset(&action.sa_mask);
+    return sigaction(SIGSEGV, &action,
+                     &previous_action) == 0;
+  }();
+  if (!installed) {
+    throw std::bad_alloc();
+  }
+}
+
+/// Registers the address range of a tape, or returns
+/// nullptr if there are too many live tapes.
+inline region_t *acquire_region(
+    std::uintptr_t begin, std::uintptr_t committed,
+    std::uintptr_t end) {
+  for (region_t &region : regions) {
+    std::uintptr_t expected = 0;
+    if (region.end.compare_exchange_strong(expected,
+                                           end)) {
+      region.committed.store(
+          committed, std::memory_order_relaxed);
+      region.begin.store(begin,
+                         std::memory_order_release);
+      return &region;
+    }
+  }
+  return nullptr;
+}
+
+inline void release_region(region_t &region) {
+  region.begin.store(0, std::memory_order_release);
+  region.end.store(0, std::memory_order_release);
+}
+
+} // namespace guarded_tape_impl
+
+/// Tape of Size cells in a reserved address range
+/// that is committed as it is reached, see the top of
+/// this file. Out of tape accesses that hit a guard
+/// region abort the program, and accesses further
+/// away are not detected. Tapes are
+/// movable, and cells keep their address.
+template <typename Cell, std::size_t Size>
+class guarded_tape_t {
+public:
+  guarded_tape_t() {
+    using namespace guarded_tape_impl;
+    install_handler();
+
+    void *const base =
+        mmap(nullptr, mapped_bytes(), PROT_NONE,
+             MAP_PRIVATE | MAP_ANONYMOUS |
+                 MAP_NORESERVE,
+             -1, 0);
+    if (base == MAP_FAILED) {
+      throw std::bad_alloc();
+    }
+    cells_ = reinterpret_cast<Cell *>(
+        static_cast<char *>(base) + guard_size);
+
+    std::size_t const initial = std::min(
+        reserved_bytes(), commit_granularity);
+    auto const begin =
+        reinterpret_cast<std::uintptr_t>(cells_);
+    if (mprotect(cells_, initial,
+                 PROT_READ | PROT_WRITE) != 0 ||
+        (region_ = acquire_region(
+             begin, begin + initial,
+             begin + reserved_bytes())) == nullptr) {
+      munmap(base, mapped_bytes());
+      throw std::bad_alloc();
+    }
+  }
+
+  guarded_tape_t(guarded_tape_t &&other)
+      : cells_(std::exchange(other.cells_, nullptr)),
+        region_(
+            std::exchange(other.region_, nullptr)) {}
+
+  guarded_tape_t &operator=(guarded_tape_t other) {
+    std::swap(cells_, other.cells_);
+    std::swap(region_, other.region_);
+    return *this;
+  }
+
+  ~guarded_tape_t() {
+    if (region_ != nullptr) {
+      guarded_tape_impl::release_region(*region_);
+      munmap(reinterpret_cast<char *>(cells_) -
+                 guarded_tape_impl::guard_size,
+             mapped_bytes());
+    }
+  }
+
+  Cell *data() { return cells_; }
+  Cell const *data() const { return cells_; }
+  static constexpr std::size_t size() { return Size; }
+
+  Cell &operator[](std::size_t i) {
+    return cells_[i];
+  }
+  Cell const &operator[](std::size_t i) const {
+    return cells_[i];
+  }
+
+  /// Iterating over the whole tape commits all of it,
+  /// see clear to reset cells.
+  Cell *begin() { return data(); }
+  Cell *end() { return data() + Size; }
+  Cell const *begin() const { return data(); }
+  Cell const *end() const { return data() + Size; }
+
+  /// Returns the number of committed cells.
+  std::size_t committed_size() const {
+    auto const begin =
+        reinterpret_cast<std::uintptr_t>(cells_);
+    return (region_->committed.load(
+                std::memory_order_relaxed) -
+            begin) /
+           sizeof(Cell);
+  }
+
+  /// Sets all the cells to zero. The committed pages
+  /// are given back to the system rather than written
+  /// to, when the system allows it.
+  void clear() {
+    std::size_t const size = committed_size();
+#if defined(__linux__)
+    // Private anonymous pages read as zero after this
+    if (madvise(cells_, size * sizeof(Cell),
+                MADV_DONTNEED) == 0) {
+      return;
+    }
+#endif
+    std::fill_n(cells_, size, Cell(0));
+  }
+
+private:
+  /// Bytes of the cells, rounded up to pages
+  static constexpr std::size_t reserved_bytes() {
+    return guarded_tape_impl::round_up(Size *
+                                       sizeof(Cell));
+  }
+
+  /// Bytes of the whole mapping, ie. the reserved
+  /// bytes and the guard regions
+  static constexpr std::size_t mapped_bytes() {
+    return reserved_bytes() +
+           2 * guarded_tape_impl::guard_size;
+  }
+
+  Cell *cells_ = nullptr;
+  guarded_tape_impl::region_t *region_ = nullptr;
+};
+
+/// Tape storage policy of basic_program_state_t, see
+/// guarded_tape_t.
+struct guarded_storage_t {
+  template <typename Cell, std::size_t Size>
+  using tape_t = guarded_tape_t<Cell, Size>;
+};
+
+/// Program state with a growable tape of
+/// guarded_tape_size cells.
+using guarded_program_state_t =
+    basic_program_state_t<guarded_tape_size, char,
+                          guarded_storage_t>;
+
+} // namespace brainfuck
+
+#endif
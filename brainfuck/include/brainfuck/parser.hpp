@@ -1,6 +1,7 @@
 #pragma once
 
 #include <algorithm>
+#include <cstddef>
 
 #include <iterator>
 #include <memory>
@@ -84,4 +85,23 @@ parse_ast(std::string const &input) {
       std::move(parse_result));
 }
 
+/// Returns true if the brackets of a BF program are
+/// balanced. parse_ast ignores what follows an
+/// unmatched ], and closes unmatched [ at the end of
+/// the program.
+constexpr bool is_balanced(std::string const &input) {
+  std::size_t depth = 0;
+  for (char c : input) {
+    if (c == while_begin_v) {
+      depth++;
+    } else if (c == while_end_v) {
+      if (depth == 0) {
+        return false;
+      }
+      depth--;
+    }
+  }
+  return depth == 0;
+}
+
 } // namespace brainfuck::parser
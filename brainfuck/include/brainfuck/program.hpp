@@ -1,6 +1,15 @@
 #pragma once
 
+#include <algorithm>
 #include <array>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <utility>
+#include <vector>
 
 // #include <cest/iostream.hpp>
 // #include <cest/istream.hpp>
@@ -10,15 +19,318 @@
 
 namespace brainfuck {
 
-struct program_state_t {
-  constexpr program_state_t() : i(0) {
-    for (auto &c : data) {
-      c = 0;
+/// Default tape size
+inline constexpr std::size_t default_tape_size =
+    30000;
+
+/// Tape allocated on the heap, which keeps states
+/// small and movable whatever the tape size.
+template <typename Cell, std::size_t Size>
+class heap_tape_t {
+public:
+  heap_tape_t()
+      : cells_(std::make_unique<Cell[]>(Size)) {}
+
+  Cell *data() { return cells_.get(); }
+  Cell const *data() const { return cells_.get(); }
+  static constexpr std::size_t size() { return Size; }
+
+  Cell &operator[](std::size_t i) {
+    return cells_[i];
+  }
+  Cell const &operator[](std::size_t i) const {
+    return cells_[i];
+  }
+
+  Cell *begin() { return data(); }
+  Cell *end() { return data() + Size; }
+  Cell const *begin() const { return data(); }
+  Cell const *end() const { return data() + Size; }
+
+protected:
+  explicit heap_tape_t(std::unique_ptr<Cell[]> cells)
+      : cells_(std::move(cells)) {}
+
+  std::unique_ptr<Cell[]> cells_;
+};
+
+/// Heap tape whose allocation is given back to a
+/// per-thread pool on destruction, and reused by the
+/// next tape of the same type created by the thread.
+/// Reused tapes are cleared, which is cheaper than
+/// allocating and faulting in fresh pages when many
+/// short programs run one after another.
+template <typename Cell, std::size_t Size>
+class pooled_tape_t : public heap_tape_t<Cell, Size> {
+public:
+  pooled_tape_t()
+      : heap_tape_t<Cell, Size>(acquire()) {}
+
+  pooled_tape_t(pooled_tape_t &&) = default;
+  pooled_tape_t &
+  operator=(pooled_tape_t &&) = default;
+
+  ~pooled_tape_t() {
+    if (this->cells_ != nullptr) {
+      pool().push_back(std::move(this->cells_));
+    }
+  }
+
+private:
+  using cells_t = std::unique_ptr<Cell[]>;
+
+  static std::vector<cells_t> &pool() {
+    thread_local std::vector<cells_t> free_tapes;
+    return free_tapes;
+  }
+
+  static cells_t acquire() {
+    std::vector<cells_t> &free_tapes = pool();
+    if (free_tapes.empty()) {
+      return std::make_unique<Cell[]>(Size);
     }
+    cells_t cells = std::move(free_tapes.back());
+    free_tapes.pop_back();
+    std::fill_n(cells.get(), Size, Cell(0));
+    return cells;
   }
+};
+
+/// Tape storage policies of basic_program_state_t.
 
-  std::array<char, 30000> data;
-  std::size_t i;
+/// Tape stored in the state itself. It is the
+/// cheapest to access, and the default.
+struct inline_storage_t {
+  template <typename Cell, std::size_t Size>
+  using tape_t = std::array<Cell, Size>;
 };
 
+/// Tape allocated on the heap, see heap_tape_t.
+struct heap_storage_t {
+  template <typename Cell, std::size_t Size>
+  using tape_t = heap_tape_t<Cell, Size>;
+};
+
+/// Tape taken from a per-thread pool, see
+/// pooled_tape_t.
+struct pooled_storage_t {
+  template <typename Cell, std::size_t Size>
+  using tape_t = pooled_tape_t<Cell, Size>;
+};
+
+/// I/O policies of basic_program_state_t. A policy
+/// is a base of the state, and redirects I/O by
+/// providing put, write and get member functions, see
+/// output_char and input_char.
+
+/// Reads and writes one character at a time with
+/// std::getchar and std::putchar, which lock the
+/// standard streams for every character.
+struct stdio_io_t {};
+
+/// Appends output to a user-space buffer, which is
+/// written to stdout when it is full, before reading
+/// input, on flush and on destruction. Appending is
+/// inlined in the generated code.
+class buffered_io_t {
+public:
+  static constexpr std::size_t buffer_size = 1 << 16;
+
+  buffered_io_t() {
+    std::lock_guard lock(live_mutex_);
+    next_ = std::exchange(live_, this);
+    if (next_ != nullptr) {
+      next_->previous_ = this;
+    }
+  }
+
+  buffered_io_t(buffered_io_t const &) = delete;
+  buffered_io_t &
+  operator=(buffered_io_t const &) = delete;
+
+  ~buffered_io_t() {
+    flush();
+    std::lock_guard lock(live_mutex_);
+    (previous_ != nullptr ? previous_->next_
+                          : live_) = next_;
+    if (next_ != nullptr) {
+      next_->previous_ = previous_;
+    }
+  }
+
+  void put(char c) {
+    if (size_ == buffer_size) [[unlikely]] {
+      flush();
+    }
+    buffer_[size_++] = c;
+  }
+
+  void write(char const *text, std::size_t size) {
+    if (size > buffer_size - size_) {
+      flush();
+      if (size > buffer_size) {
+        std::fwrite(text, 1, size, stdout);
+        return;
+      }
+    }
+    std::copy_n(text, size, buffer_.data() + size_);
+    size_ += size;
+  }
+
+  /// Pending output is written first, so that
+  /// interactive programs show their prompts.
+  int get() {
+    if (size_ != 0) {
+      flush();
+    }
+    return std::getchar();
+  }
+
+  void flush() {
+    std::fwrite(buffer_.data(), 1, size_, stdout);
+    std::fflush(stdout);
+    size_ = 0;
+  }
+
+  /// Flushes all the live buffers, before aborting on
+  /// errors that have no access to the state, see
+  /// guarded_tape_t. It is best effort, as buffers of
+  /// other threads may be in use, and it does nothing
+  /// while a buffer is created or destroyed.
+  static void flush_all() {
+    std::unique_lock lock(live_mutex_,
+                          std::try_to_lock);
+    if (!lock.owns_lock()) {
+      return;
+    }
+    for (buffered_io_t *io = live_; io != nullptr;
+         io = io->next_) {
+      io->flush();
+    }
+  }
+
+private:
+  std::array<char, buffer_size> buffer_;
+  std::size_t size_ = 0;
+
+  // Live buffers, see flush_all
+  inline static std::mutex live_mutex_;
+  inline static buffered_io_t *live_ = nullptr;
+  buffered_io_t *previous_ = nullptr;
+  buffered_io_t *next_ = nullptr;
+};
+
+/// Buffered output, and input read from memory. The
+/// input must be set before running a program, and
+/// reading past its end returns EOF.
+class span_input_io_t : public buffered_io_t {
+public:
+  std::span<char const> input;
+  std::size_t input_pos = 0;
+
+  int get() {
+    return input_pos < input.size()
+               ? static_cast<unsigned char>(
+                     input[input_pos++])
+               : EOF;
+  }
+};
+
+/// Program state, ie. a tape of TapeSize cells of
+/// type Cell and a pointer. Cells are usually char,
+/// or std::uint8_t, std::uint16_t and std::uint32_t
+/// for programs written for wider cells. Input and
+/// output always go through the low byte of the
+/// cells, and through the IO policy. Backends access
+/// the state through its data and i members and the
+/// I/O functions only, so they work with any of these
+/// parameters.
+template <std::size_t TapeSize = default_tape_size,
+          typename Cell = char,
+          typename Storage = inline_storage_t,
+          typename IO = stdio_io_t>
+struct basic_program_state_t : IO {
+  using cell_t = Cell;
+  static constexpr std::size_t tape_size = TapeSize;
+
+  typename Storage::template tape_t<Cell, TapeSize>
+      data{};
+  std::size_t i = 0;
+};
+
+using program_state_t = basic_program_state_t<>;
+
+/// Program state with buffered output, see
+/// buffered_io_t.
+using buffered_program_state_t =
+    basic_program_state_t<default_tape_size, char,
+                          inline_storage_t,
+                          buffered_io_t>;
+
+/// Writes a character to the output of a program.
+/// States can redirect their output by providing a
+/// put member function, otherwise it goes to stdout.
+template <typename State>
+inline void output_char(State &s, char c) {
+  if constexpr (requires { s.put(c); }) {
+    s.put(c);
+  } else {
+    std::putchar(c);
+  }
+}
+
+/// Writes constant output, see output_char. States
+/// can provide a write member function.
+template <typename State>
+inline void output_text(State &s, char const *text,
+                        std::size_t size) {
+  if constexpr (requires { s.write(text, size); }) {
+    s.write(text, size);
+  } else if constexpr (requires { s.put(*text); }) {
+    for (std::size_t k = 0; k < size; k++) {
+      s.put(text[k]);
+    }
+  } else {
+    std::fwrite(text, 1, size, stdout);
+  }
+}
+
+/// Reads a character from the input of a program,
+/// and returns it as an unsigned char converted to
+/// int, or EOF, like std::getchar. States can
+/// redirect their input by providing a get member
+/// function, otherwise it comes from stdin.
+template <typename State>
+inline int input_char(State &s) {
+  if constexpr (requires { s.get(); }) {
+    return s.get();
+  } else {
+    return std::getchar();
+  }
+}
+
+/// Reports a tape access out of bounds, then aborts.
+/// Pending output is written first, since abort does
+/// not flush the standard streams.
+[[noreturn]] inline void out_of_tape(std::size_t i) {
+  std::fflush(stdout);
+  std::fprintf(stderr,
+               "brainfuck: tape access out of bounds "
+               "(pointer: %td)\n",
+               std::ptrdiff_t(i));
+  std::abort();
+}
+
+/// Reports a tape access out of bounds like above,
+/// after writing the output buffered by the IO policy
+/// of the state, if any.
+template <typename State>
+[[noreturn]] void out_of_tape(State &s,
+                              std::size_t i) {
+  if constexpr (requires { s.flush(); }) {
+    s.flush();
+  }
+  out_of_tape(i);
+}
+
 } // namespace brainfuck
@@ -0,0 +1,139 @@
+#include "cli.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <string_view>
+
+#include <brainfuck/backends/flat/bytecode.hpp>
+#include <brainfuck/backends/flat/jit.hpp>
+#include <brainfuck/guarded-tape.hpp>
+#include <brainfuck/parser.hpp>
+#include <brainfuck/program.hpp>
+
+namespace brainfuck::cli {
+
+namespace {
+
+/// Command line options
+struct options_t {
+  char const *path = nullptr;
+  flat::optimization_level_t level =
+      flat::default_optimization_level;
+
+  /// Programs loaded at runtime are not trusted, so
+  /// their tape accesses are checked by default
+  bool bounds_checks = true;
+
+  /// Runs the program with the JIT instead of the
+  /// bytecode interpreter
+  bool jit = false;
+
+  /// Runs the program on a guarded tape, which grows
+  /// as needed and detects out of tape accesses with
+  /// guard pages instead of bounds checks
+  bool guarded_tape = false;
+};
+
+int usage(char const *name) {
+  std::fprintf(stderr,
+               "usage: %s [-O0|-O1|-O2|-O3] "
+               "[--unchecked] [--jit] "
+               "[--guarded-tape] <program.bf>\n",
+               name);
+  return 2;
+}
+
+} // namespace
+
+int run(int argc, char **argv) {
+  options_t options;
+
+  for (int k = 1; k < argc; k++) {
+    std::string_view const arg = argv[k];
+    if (arg.size() == 3 && arg.starts_with("-O") &&
+        arg[2] >= '0' && arg[2] <= '3') {
+      options.level =
+          flat::optimization_level_t(arg[2] - '0');
+    } else if (arg == "--unchecked") {
+      options.bounds_checks = false;
+    } else if (arg == "--jit") {
+      options.jit = true;
+    } else if (arg == "--guarded-tape") {
+      options.guarded_tape = true;
+    } else if (!arg.starts_with("-") &&
+               options.path == nullptr) {
+      options.path = argv[k];
+    } else {
+      return usage(argv[0]);
+    }
+  }
+
+  if (options.path == nullptr) {
+    return usage(argv[0]);
+  }
+
+  std::ifstream file(options.path);
+  if (!file) {
+    std::fprintf(stderr, "%s: cannot open %s\n",
+                 argv[0], options.path);
+    return 1;
+  }
+  std::stringstream source;
+  source << file.rdbuf();
+
+  if (!parser::is_balanced(source.str())) {
+    std::fprintf(stderr,
+                 "%s: unbalanced brackets in %s\n",
+                 argv[0], options.path);
+    return 1;
+  }
+
+  // Guard pages replace the bounds checks
+  flat::flat_ast_t const ast =
+      flat::parse_to_flat_ast(
+          source.str(), options.level,
+          options.bounds_checks &&
+              !options.guarded_tape);
+
+  auto const execute = [&](auto &s) {
+    if (options.jit) {
+#ifdef BRAINFUCK_HAS_JIT
+      flat::jit::run(flat::jit::compile(ast), s);
+#else
+      std::fprintf(stderr,
+                   "%s: the JIT does not support "
+                   "this target\n",
+                   argv[0]);
+      return 1;
+#endif
+    } else {
+      flat::bytecode::run(
+          flat::bytecode::compile(ast), s);
+    }
+    return 0;
+  };
+
+  if (options.guarded_tape) {
+#ifdef BRAINFUCK_HAS_GUARDED_TAPE
+    auto s = std::make_unique<basic_program_state_t<
+        guarded_tape_size, char, guarded_storage_t,
+        buffered_io_t>>();
+    return execute(*s);
+#else
+    std::fprintf(stderr,
+                 "%s: guarded tapes are not "
+                 "supported on this target\n",
+                 argv[0]);
+    return 1;
+#endif
+  }
+
+  auto s =
+      std::make_unique<buffered_program_state_t>();
+  return execute(*s);
+}
+
+} // namespace brainfuck::cli
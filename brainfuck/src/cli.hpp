@@ -0,0 +1,13 @@
+#pragma once
+
+namespace brainfuck::cli {
+
+/// Runs the BF program file given on the command
+/// line with the bytecode backend, or the JIT, and
+/// returns the exit status of the process.
+///
+/// Usage: brainfuck [-O0|-O1|-O2|-O3] [--unchecked]
+///                  [--jit] <program.bf>
+int run(int argc, char **argv);
+
+} // namespace brainfuck::cli
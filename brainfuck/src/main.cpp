@@ -2,9 +2,25 @@
 #define ET 1
 #define FLAT_OVER 2
 #define FLAT_MONO 3
+#define FLAT_PE 4
+#define FLAT_CACHED 5
+#define FLAT_CHECKED 6
+#define FLAT_TABLE 7
+#define FLAT_TAIL_CALL 8
+#define FLAT_HYBRID 9
+#define FLAT_STREAM 10
+#define FLAT_BATCH 11
+#define FLAT_SPMD 12
 
 #define BRAINFUCK_BACKEND FLAT_MONO
 
+// Optimization level of the flat backends, see
+// flat/pass-manager.hpp
+#define BRAINFUCK_OPT_LEVEL o3_v
+
+// I/O policy of the program states, see program.hpp
+#define BRAINFUCK_IO buffered_io_t
+
 #if BRAINFUCK_BACKEND == PBG
 #include <brainfuck/backends/pass_by_generator.hpp>
 #endif
@@ -14,21 +30,63 @@
 #if BRAINFUCK_BACKEND == FLAT_OVER
 #include <brainfuck/backends/flat/overloaded-codegen.hpp>
 #endif
-#if BRAINFUCK_BACKEND == FLAT_MONO
+#if BRAINFUCK_BACKEND == FLAT_MONO ||                \
+    BRAINFUCK_BACKEND == FLAT_CHECKED
+#include <brainfuck/backends/flat/monolithic-codegen.hpp>
+#endif
+#if BRAINFUCK_BACKEND == FLAT_PE
+#include <brainfuck/backends/flat/monolithic-codegen.hpp>
+#include <brainfuck/backends/flat/partial-evaluation.hpp>
+#endif
+#if BRAINFUCK_BACKEND == FLAT_CACHED
+#include <brainfuck/backends/flat/cached-codegen.hpp>
+#endif
+#if BRAINFUCK_BACKEND == FLAT_TABLE
+#include <brainfuck/backends/flat/table-codegen.hpp>
+#endif
+#if BRAINFUCK_BACKEND == FLAT_TAIL_CALL
+#include <brainfuck/backends/flat/tail-call-codegen.hpp>
+#endif
+#if BRAINFUCK_BACKEND == FLAT_HYBRID
+#include <brainfuck/backends/flat/hybrid-codegen.hpp>
+#endif
+#if BRAINFUCK_BACKEND == FLAT_STREAM
+#include <brainfuck/backends/flat/stream.hpp>
+#endif
+#if BRAINFUCK_BACKEND == FLAT_BATCH
+#include <iostream>
+#include <string>
+#include <vector>
+
 #include <brainfuck/backends/flat/monolithic-codegen.hpp>
+#include <brainfuck/batch.hpp>
+#endif
+#if BRAINFUCK_BACKEND == FLAT_SPMD
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <brainfuck/backends/flat/spmd-codegen.hpp>
 #endif
 
 #include <brainfuck/example_programs.hpp>
 #include <brainfuck/parser.hpp>
 
+#include "cli.hpp"
+
 static constexpr auto program_string =
     brainfuck::example_programs::mandelbrot;
 namespace bf = brainfuck;
 
+/// State of the compiled programs
+using state_t = bf::basic_program_state_t<
+    bf::default_tape_size, char, bf::inline_storage_t,
+    bf::BRAINFUCK_IO>;
+
 #if BRAINFUCK_BACKEND == PBG
-int main() {
+void run_compiled() {
   // Pass by generator backend
-  bf::program_state_t s;
+  state_t s;
   auto code =
       bf::pass_by_generator::codegen<[]() constexpr {
         return std::move(
@@ -39,8 +97,8 @@ int main() {
 #endif
 
 #if BRAINFUCK_BACKEND == ET
-int main() {
-  bf::program_state_t s;
+void run_compiled() {
+  state_t s;
 
   auto expression_template =
       bf::expression_template::to_et([]() {
@@ -53,29 +111,230 @@ int main() {
 #endif
 
 #if BRAINFUCK_BACKEND == FLAT_OVER
-int main() {
+void run_compiled() {
   static constexpr auto FlatAst =
       bf::flat::parse_to_fixed_flat_ast<
-          program_string>();
+          program_string,
+          bf::flat::BRAINFUCK_OPT_LEVEL>();
 
   // Calling the overloaded implementation
   {
-    bf::program_state_t s;
+    state_t s;
     bf::flat::overloaded::codegen<FlatAst>()(s);
   }
 }
 #endif
 
 #if BRAINFUCK_BACKEND == FLAT_MONO
-int main() {
+void run_compiled() {
   static constexpr auto FlatAst =
       bf::flat::parse_to_fixed_flat_ast<
-          program_string>();
+          program_string,
+          bf::flat::BRAINFUCK_OPT_LEVEL>();
 
   // Calling the monolithic implementation
   {
-    bf::program_state_t s;
+    state_t s;
     bf::flat::monolithic::codegen<FlatAst>()(s);
   }
 }
 #endif
+
+#if BRAINFUCK_BACKEND == FLAT_PE
+void run_compiled() {
+  using evaluated_program_t =
+      bf::flat::partially_evaluated_program_t<
+          program_string>;
+
+  // Writing the output of the evaluated prefix,
+  // then calling the monolithic implementation for
+  // the rest
+  {
+    state_t s;
+    evaluated_program_t::prelude(s);
+    bf::flat::monolithic::codegen<
+        evaluated_program_t::residual_ast>()(s);
+  }
+}
+#endif
+
+#if BRAINFUCK_BACKEND == FLAT_CACHED
+void run_compiled() {
+  static constexpr auto FlatAst =
+      bf::flat::parse_to_fixed_flat_ast<
+          program_string,
+          bf::flat::BRAINFUCK_OPT_LEVEL>();
+
+  // Calling the implementation with a cached pointer
+  // and current cell
+  {
+    state_t s;
+    bf::flat::cached::codegen<FlatAst>()(s);
+  }
+}
+#endif
+
+#if BRAINFUCK_BACKEND == FLAT_CHECKED
+void run_compiled() {
+  static constexpr auto FlatAst =
+      bf::flat::parse_to_fixed_flat_ast<
+          program_string,
+          bf::flat::BRAINFUCK_OPT_LEVEL, true>();
+
+  // Calling the monolithic implementation with bounds
+  // checks, and a tape sized to the program if its
+  // accesses are proven to be in bounds
+  {
+    bf::flat::sized_program_state_t<
+        FlatAst, char, bf::inline_storage_t,
+        bf::BRAINFUCK_IO>
+        s;
+    bf::flat::monolithic::codegen<FlatAst>()(s);
+  }
+}
+#endif
+
+#if BRAINFUCK_BACKEND == FLAT_TABLE
+void run_compiled() {
+  static constexpr auto FlatAst =
+      bf::flat::parse_to_fixed_flat_ast<
+          program_string,
+          bf::flat::BRAINFUCK_OPT_LEVEL>();
+
+  // Calling the function pointer table
+  // implementation
+  {
+    state_t s;
+    bf::flat::table::codegen<FlatAst>()(s);
+  }
+}
+#endif
+
+#if BRAINFUCK_BACKEND == FLAT_TAIL_CALL
+void run_compiled() {
+  static constexpr auto FlatAst =
+      bf::flat::parse_to_fixed_flat_ast<
+          program_string,
+          bf::flat::BRAINFUCK_OPT_LEVEL>();
+
+  // Calling the tail call implementation
+  {
+    state_t s;
+    bf::flat::tail_call::codegen<FlatAst>()(s);
+  }
+}
+#endif
+
+#if BRAINFUCK_BACKEND == FLAT_HYBRID
+void run_compiled() {
+  static constexpr auto FlatAst =
+      bf::flat::parse_to_fixed_flat_ast<
+          program_string,
+          bf::flat::BRAINFUCK_OPT_LEVEL>();
+
+  // Calling the hybrid implementation, which
+  // generates the hottest loops within the default
+  // instantiation budget
+  {
+    state_t s;
+    bf::flat::hybrid::codegen<FlatAst>()(s);
+  }
+}
+#endif
+
+#if BRAINFUCK_BACKEND == FLAT_STREAM
+void run_compiled() {
+  static constexpr auto FlatAst =
+      bf::flat::parse_to_fixed_flat_ast<
+          program_string,
+          bf::flat::BRAINFUCK_OPT_LEVEL>();
+
+  // Running the program as a coroutine, and piping
+  // its output and input chunks through the
+  // standard streams
+  {
+    bf::program_state_t s;
+    auto stream = bf::flat::stream::run<FlatAst>(s);
+    std::array<char, 4096> input;
+
+    while (stream.next()) {
+      if (stream.wants_input()) {
+        size_t const size = std::fread(
+            input.data(), 1, input.size(), stdin);
+        stream.provide_input(
+            std::span(input.data(), size));
+      } else {
+        std::fwrite(stream.output().data(), 1,
+                    stream.output().size(), stdout);
+      }
+    }
+  }
+}
+#endif
+
+#if BRAINFUCK_BACKEND == FLAT_BATCH
+void run_compiled() {
+  static constexpr auto FlatAst =
+      bf::flat::parse_to_fixed_flat_ast<
+          program_string,
+          bf::flat::BRAINFUCK_OPT_LEVEL>();
+
+  // Running the program once per line of the
+  // standard input on all threads, and writing the
+  // outputs in the order of the lines
+  {
+    std::vector<std::string> lines;
+    for (std::string line;
+         std::getline(std::cin, line);) {
+      lines.push_back(std::move(line));
+    }
+    std::vector<std::string_view> const records(
+        lines.begin(), lines.end());
+
+    for (std::string const &output :
+         bf::batch::run_batch(
+             bf::flat::monolithic::codegen<FlatAst>(),
+             records)) {
+      std::fwrite(output.data(), 1, output.size(),
+                  stdout);
+    }
+  }
+}
+#endif
+
+#if BRAINFUCK_BACKEND == FLAT_SPMD
+void run_compiled() {
+  static constexpr auto FlatAst =
+      bf::flat::parse_to_fixed_flat_ast<
+          program_string,
+          bf::flat::BRAINFUCK_OPT_LEVEL>();
+
+  // Running the program once per line of the
+  // standard input in SIMD lanes, and writing the
+  // outputs in the order of the lines
+  {
+    std::vector<std::string> lines;
+    for (std::string line;
+         std::getline(std::cin, line);) {
+      lines.push_back(std::move(line));
+    }
+    std::vector<std::string_view> const records(
+        lines.begin(), lines.end());
+
+    for (std::string const &output :
+         bf::flat::spmd::run<FlatAst>(records)) {
+      std::fwrite(output.data(), 1, output.size(),
+                  stdout);
+    }
+  }
+}
+#endif
+
+int main(int argc, char **argv) {
+  // Programs given on the command line are run by the
+  // runtime backend instead
+  if (argc > 1) {
+    return bf::cli::run(argc, argv);
+  }
+  run_compiled();
+}
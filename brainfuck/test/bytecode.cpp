@@ -0,0 +1,16 @@
+#include "differential.hpp"
+
+namespace bf = brainfuck;
+
+int main() {
+  return bf::test::check_all(
+      []<auto const &Source,
+         bf::flat::optimization_level_t Level,
+         bool Checks>(bf::test::state_t &s) {
+        bf::flat::bytecode::run(
+            bf::flat::bytecode::compile(
+                bf::flat::parse_to_flat_ast(
+                    Source, Level, Checks)),
+            s);
+      });
+}
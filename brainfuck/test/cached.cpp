@@ -0,0 +1,17 @@
+#include "differential.hpp"
+
+#include <brainfuck/backends/flat/cached-codegen.hpp>
+
+namespace bf = brainfuck;
+
+int main() {
+  return bf::test::check_all(
+      []<auto const &Source,
+         bf::flat::optimization_level_t Level,
+         bool Checks>(bf::test::state_t &s) {
+        static constexpr auto FlatAst =
+            bf::flat::parse_to_fixed_flat_ast<
+                Source, Level, Checks>();
+        bf::flat::cached::codegen<FlatAst>()(s);
+      });
+}
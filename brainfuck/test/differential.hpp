@@ -0,0 +1,346 @@
+#pragma once
+
+// Differential tests: a backend runs the example
+// programs and small programs that read input, at
+// every optimization level, with and without bounds
+// checks. Its output, final pointer and final tape
+// must match those of the bytecode interpreter at
+// O0, ie. of the unoptimized program. Programs that
+// go out of the tape run in a child process, with
+// bounds checks only, and must write the same output
+// before aborting.
+//
+// Each backend has its own test executable, which
+// calls check_all with a function that runs a
+// program on a state:
+//
+//   int main() {
+//     return test::check_all(
+//         []<auto const &Source,
+//            flat::optimization_level_t Level,
+//            bool Checks>(test::state_t &s) {
+//           ...
+//         });
+//   }
+
+#include <csignal>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <brainfuck/backends/flat.hpp>
+#include <brainfuck/backends/flat/bytecode.hpp>
+#include <brainfuck/batch.hpp>
+#include <brainfuck/example_programs.hpp>
+
+namespace brainfuck::test {
+
+/// State of the tested programs, whose input and
+/// output are memory buffers
+struct state_t : batch::record_state_t {
+  /// Writes the output to stdout. Called by
+  /// out_of_tape before aborting, see check_abort.
+  void flush() {
+    std::fwrite(output.data(), 1, output.size(),
+                stdout);
+    std::fflush(stdout);
+    output.clear();
+  }
+};
+
+/// Programs that read input. Reading past the end of
+/// the input stores EOF, ie. -1, so programs that
+/// read until the end add 1 to the cells they read.
+namespace input_programs {
+
+/// Writes its input back
+static constexpr char const *echo = ",+[-.,+]";
+
+/// Writes its input in reverse order
+static constexpr char const *reverse =
+    ">,+[->,+]<[.<]";
+
+/// Copies a cell to the next two cells, and moves
+/// the second copy back to the first one
+static constexpr char const *copy =
+    ",[->+>+<<]>>[-<+>]";
+
+/// Writes the sum of two digits
+static constexpr char const *add =
+    ",>,[-<+>]<------------------------"
+    "------------------------.";
+
+/// Scans back to the first cell, which is zero
+static constexpr char const *scan = ">+>+>+>,[<]>.";
+
+/// Moves a cell to the left of the tape, which is
+/// out of bounds unless the cell is zero. Since the
+/// loop does not run then, neither the lowered
+/// multiply loop nor its bounds check may access the
+/// target.
+static constexpr char const *move_left = ",[<+>-]";
+
+/// Writes its input up to the first zero, then goes
+/// out of the tape. The check of the last access may
+/// not be hoisted above the loop.
+static constexpr char const *echo_then_fail =
+    ",[.,]<+>";
+
+} // namespace input_programs
+
+inline constexpr std::string_view no_input[] = {""};
+
+inline constexpr std::string_view text_inputs[] = {
+    "", "Hello, World!",
+    std::string_view("\0\xff", 2)};
+
+inline constexpr std::string_view digit_inputs[] = {
+    "34", "90", "0"};
+
+inline constexpr std::string_view zero_input[] = {
+    std::string_view("\0", 1)};
+
+inline constexpr std::string_view
+    zero_terminated_inputs[] = {
+        std::string_view("\0", 1),
+        std::string_view("abc\0", 4)};
+
+/// What a run leaves behind
+struct result_t {
+  std::string output;
+  std::size_t pointer;
+  std::vector<char> tape;
+
+  bool operator==(result_t const &) const = default;
+};
+
+inline result_t result(state_t const &s) {
+  return {s.output, s.i,
+          std::vector<char>(s.data.begin(),
+                            s.data.end())};
+}
+
+/// Runs a program with the unoptimized bytecode
+/// interpreter.
+inline result_t
+run_reference(std::string const &source,
+              std::string_view input) {
+  auto s = std::make_unique<state_t>();
+  s->reset(input);
+  flat::bytecode::run(flat::bytecode::compile(
+                          flat::parse_to_flat_ast(
+                              source, flat::o0_v)),
+                      *s);
+  return result(*s);
+}
+
+/// Runs a program on each input at every
+/// optimization level, with and without bounds
+/// checks, and reports the runs whose result differs
+/// from the reference on stderr. Returns the number
+/// of failed runs.
+template <auto const &Source>
+std::size_t
+check(std::string_view name,
+      std::span<std::string_view const> inputs,
+      auto const &run) {
+  std::size_t failures = 0;
+
+  for (std::size_t k = 0; k < inputs.size(); k++) {
+    result_t const expected =
+        run_reference(Source, inputs[k]);
+
+    auto const check_run =
+        [&]<flat::optimization_level_t Level,
+            bool Checks>() {
+          auto s = std::make_unique<state_t>();
+          s->reset(inputs[k]);
+          run.template operator()<Source, Level,
+                                  Checks>(*s);
+
+          result_t const actual = result(*s);
+          if (actual != expected) {
+            std::fprintf(
+                stderr,
+                "%.*s: wrong %s at O%u%s on input "
+                "%zu\n",
+                int(name.size()), name.data(),
+                actual.output != expected.output
+                    ? "output"
+                    : "tape",
+                unsigned(Level),
+                Checks ? " with bounds checks" : "",
+                k);
+            failures++;
+          }
+        };
+
+    [&]<std::size_t... Levels>(
+        std::index_sequence<Levels...>) {
+      (check_run.template operator()<
+           flat::optimization_level_t(Levels),
+           false>(),
+       ...);
+      (check_run.template operator()<
+           flat::optimization_level_t(Levels),
+           true>(),
+       ...);
+    }(std::make_index_sequence<flat::o3_v + 1>{});
+  }
+
+  return failures;
+}
+
+/// What a run in a child process leaves behind
+struct child_result_t {
+  std::string output;
+  bool aborted;
+
+  bool operator==(child_result_t const &) const =
+      default;
+};
+
+/// Runs a function in a child process, whose stdout
+/// is read back and whose stderr is discarded.
+inline child_result_t
+run_in_child(auto const &function) {
+  int fds[2];
+  if (pipe(fds) != 0) {
+    std::perror("pipe");
+    std::exit(EXIT_FAILURE);
+  }
+
+  std::fflush(stdout);
+  pid_t const pid = fork();
+  if (pid < 0) {
+    std::perror("fork");
+    std::exit(EXIT_FAILURE);
+  }
+
+  if (pid == 0) {
+    int const null = open("/dev/null", O_WRONLY);
+    dup2(fds[1], STDOUT_FILENO);
+    dup2(null, STDERR_FILENO);
+    close(fds[0]);
+    close(fds[1]);
+    function();
+    std::fflush(stdout);
+    std::_Exit(EXIT_SUCCESS);
+  }
+
+  close(fds[1]);
+  child_result_t result{{}, false};
+  char buffer[4096];
+  for (ssize_t size;
+       (size = read(fds[0], buffer, sizeof(buffer))) >
+       0;) {
+    result.output.append(buffer, size);
+  }
+  close(fds[0]);
+
+  int status;
+  waitpid(pid, &status, 0);
+  result.aborted = WIFSIGNALED(status) &&
+                   WTERMSIG(status) == SIGABRT;
+  return result;
+}
+
+/// Like check, for programs that go out of the tape:
+/// runs are in a child process and have bounds
+/// checks. The output written before aborting must
+/// match the reference.
+template <auto const &Source>
+std::size_t
+check_abort(std::string_view name,
+            std::span<std::string_view const> inputs,
+            auto const &run) {
+  std::size_t failures = 0;
+
+  for (std::size_t k = 0; k < inputs.size(); k++) {
+    auto const run_state = [&](auto const &body) {
+      return run_in_child([&] {
+        auto s = std::make_unique<state_t>();
+        s->reset(inputs[k]);
+        body(*s);
+        s->flush();
+      });
+    };
+
+    child_result_t const expected =
+        run_state([&](state_t &s) {
+          flat::bytecode::run(
+              flat::bytecode::compile(
+                  flat::parse_to_flat_ast(
+                      Source, flat::o0_v, true)),
+              s);
+        });
+
+    auto const check_run =
+        [&]<flat::optimization_level_t Level>() {
+          child_result_t const actual =
+              run_state([&](state_t &s) {
+                run.template operator()<Source, Level,
+                                        true>(s);
+              });
+          if (actual != expected) {
+            std::fprintf(
+                stderr,
+                "%.*s: wrong %s at O%u with bounds "
+                "checks on input %zu\n",
+                int(name.size()), name.data(),
+                actual.output != expected.output
+                    ? "output"
+                    : "termination",
+                unsigned(Level), k);
+            failures++;
+          }
+        };
+
+    [&]<std::size_t... Levels>(
+        std::index_sequence<Levels...>) {
+      (check_run.template operator()<
+           flat::optimization_level_t(Levels)>(),
+       ...);
+    }(std::make_index_sequence<flat::o3_v + 1>{});
+  }
+
+  return failures;
+}
+
+/// Checks all the test programs, see check, and
+/// returns the exit status of the test.
+inline int check_all(auto const &run) {
+  namespace ex = example_programs;
+  namespace in = input_programs;
+
+  std::size_t const failures =
+      check<ex::hello_world>("hello_world", no_input,
+                             run) +
+      check<ex::mandelbrot>("mandelbrot", no_input,
+                            run) +
+      check<in::echo>("echo", text_inputs, run) +
+      check<in::reverse>("reverse", text_inputs,
+                         run) +
+      check<in::copy>("copy", text_inputs, run) +
+      check<in::add>("add", digit_inputs, run) +
+      check<in::scan>("scan", text_inputs, run) +
+      check<in::move_left>("move_left", zero_input,
+                           run) +
+      check_abort<in::echo_then_fail>(
+          "echo_then_fail", zero_terminated_inputs,
+          run);
+
+  return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+} // namespace brainfuck::test
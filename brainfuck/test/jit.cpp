@@ -0,0 +1,26 @@
+#include "differential.hpp"
+
+#include <brainfuck/backends/flat/jit.hpp>
+
+namespace bf = brainfuck;
+
+/// Exit status of skipped tests, see CMakeLists.txt
+inline constexpr int skip_status = 77;
+
+int main() {
+#if defined(BRAINFUCK_HAS_JIT)
+  return bf::test::check_all(
+      []<auto const &Source,
+         bf::flat::optimization_level_t Level,
+         bool Checks>(bf::test::state_t &s) {
+        bf::flat::jit::run(
+            bf::flat::jit::compile(
+                bf::flat::parse_to_flat_ast(
+                    Source, Level, Checks)),
+            s);
+      });
+#else
+  std::puts("the JIT does not support this target");
+  return skip_status;
+#endif
+}
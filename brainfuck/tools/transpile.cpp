@@ -0,0 +1,122 @@
+// Ahead-of-time transpiler: writes a BF program as a
+// C++ header and source file pair, see
+// brainfuck/backends/flat/cpp-emitter.hpp and
+// cmake/transpile.cmake.
+//
+// Usage: brainfuck-transpile [-O0|-O1|-O2|-O3]
+//          [--checked] [--name <function>]
+//          <program.bf> <output>
+//
+// Writes <output>.hpp and <output>.cpp.
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <string_view>
+
+#include <brainfuck/backends/flat.hpp>
+#include <brainfuck/backends/flat/cpp-emitter.hpp>
+#include <brainfuck/parser.hpp>
+
+namespace {
+
+namespace bf = brainfuck;
+
+/// Command line options
+struct options_t {
+  char const *input = nullptr;
+  char const *output = nullptr;
+  std::string name = "run_program";
+  bf::flat::optimization_level_t level =
+      bf::flat::default_optimization_level;
+
+  /// Transpiled programs are part of the build, so
+  /// like compile time programs they are trusted by
+  /// default
+  bool bounds_checks = false;
+};
+
+int usage(char const *name) {
+  std::fprintf(stderr,
+               "usage: %s [-O0|-O1|-O2|-O3] "
+               "[--checked] [--name <function>] "
+               "<program.bf> <output>\n",
+               name);
+  return 2;
+}
+
+/// Writes a file, returns false if it cannot be
+/// written.
+bool write_file(std::string const &path,
+                std::string const &content) {
+  std::ofstream file(path);
+  file << content;
+  return bool(file);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  options_t options;
+
+  for (int k = 1; k < argc; k++) {
+    std::string_view const arg = argv[k];
+    if (arg.size() == 3 && arg.starts_with("-O") &&
+        arg[2] >= '0' && arg[2] <= '3') {
+      options.level =
+          bf::flat::optimization_level_t(arg[2] - '0');
+    } else if (arg == "--checked") {
+      options.bounds_checks = true;
+    } else if (arg == "--name" && k + 1 < argc) {
+      options.name = argv[++k];
+    } else if (!arg.starts_with("-") &&
+               options.input == nullptr) {
+      options.input = argv[k];
+    } else if (!arg.starts_with("-") &&
+               options.output == nullptr) {
+      options.output = argv[k];
+    } else {
+      return usage(argv[0]);
+    }
+  }
+
+  if (options.input == nullptr ||
+      options.output == nullptr) {
+    return usage(argv[0]);
+  }
+
+  std::ifstream file(options.input);
+  if (!file) {
+    std::fprintf(stderr, "%s: cannot open %s\n",
+                 argv[0], options.input);
+    return 1;
+  }
+  std::stringstream source;
+  source << file.rdbuf();
+
+  if (!bf::parser::is_balanced(source.str())) {
+    std::fprintf(stderr,
+                 "%s: unbalanced brackets in %s\n",
+                 argv[0], options.input);
+    return 1;
+  }
+
+  bf::flat::flat_ast_t const ast =
+      bf::flat::parse_to_flat_ast(source.str(),
+                                  options.level,
+                                  options.bounds_checks);
+
+  std::string const output = options.output;
+  if (!write_file(output + ".hpp",
+                  bf::flat::cpp_emitter::emit_header(
+                      options.name)) ||
+      !write_file(output + ".cpp",
+                  bf::flat::cpp_emitter::emit_source(
+                      ast, options.name))) {
+    std::fprintf(stderr, "%s: cannot write %s\n",
+                 argv[0], options.output);
+    return 1;
+  }
+  return 0;
+}